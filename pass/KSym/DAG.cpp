@@ -206,6 +206,34 @@ void DAGraph::recalculate(LLVMSliceLoop *l, SliceOracle *so) {
   build(so, l, l->getHeader(), l->getBlocks());
 }
 
+// ordering
+void DAGraph::topsort(DAItem *elem, vector<DAItem *> &order) {
+  set<DAItem *> seen;
+  vector<pair<DAItem *, DAItem::iterator>> stack;
+
+  seen.insert(elem);
+  stack.push_back(make_pair(elem, elem->predBegin()));
+
+  while(!stack.empty()){
+    DAItem *cur = stack.back().first;
+    DAItem::iterator &pi = stack.back().second;
+
+    // the DAG traces stop at the root
+    if(cur == root || pi == cur->predEnd()){
+      order.push_back(cur);
+      stack.pop_back();
+      continue;
+    }
+
+    DAItem *pred = *pi;
+    ++pi;
+
+    if(seen.insert(pred).second){
+      stack.push_back(make_pair(pred, pred->predBegin()));
+    }
+  }
+}
+
 // Path construction 
 static void DFS(DAItem *cur, DAItem *dom, list<DAItem *> &hist, DAPath *path) {
   hist.push_back(cur);
@@ -244,6 +244,10 @@ class DAGraph {
       return items.size();
     }
 
+    DAItem *getRoot() {
+      return root;
+    }
+
     typedef typename list<DAItem *>::iterator iterator;
 
     iterator begin() {
@@ -271,6 +275,10 @@ class DAGraph {
       return getPath(elem);
     }
 
+    // the items that may precede elem on a trace from the root, including
+    // elem itself, preds first
+    void topsort(DAItem *elem, vector<DAItem *> &order);
+
   protected:
     void add(LLVMSliceBlock *b) {
       DABlock *block = new DABlock(b);
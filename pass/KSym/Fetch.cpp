@@ -22,3 +22,57 @@ const FetchDef *Fetch::findDefMatch(const string &name) {
   }
 }
 
+// index
+FetchIndex::FetchIndex(Module &m) {
+  // fetch functions are resolved once and their call sites are found 
+  // through the use-lists, without visiting the rest of the IR
+  for(auto const &i : FILTERS){
+    Function *f = m.getFunction(i.first);
+    if(f == nullptr){
+      // not a function (e.g., an inline asm) or not used in this module
+      continue;
+    }
+
+    for(User *u : f->users()){
+      CallInst *ci = dyn_cast<CallInst>(u);
+      if(ci != nullptr && ci->getCalledFunction() == f){
+        addSite(ci, &i.second);
+      }
+    }
+  }
+
+  // inline asms are uniqued in the context, which offers no way to list
+  // them, so they are discovered from the asm calls, but the call sites of
+  // each distinct asm are then taken from its use-list at once
+  set<InlineAsm *> known;
+
+  for(Function &f : m){
+    for(BasicBlock &bb : f){
+      for(Instruction &i : bb){
+        CallInst *ci = dyn_cast<CallInst>(&i);
+        if(ci == nullptr || !ci->isInlineAsm()){
+          continue;
+        }
+
+        InlineAsm *target = cast<InlineAsm>(ci->getCalledValue());
+        if(!known.insert(target).second){
+          continue;
+        }
+
+        const FetchDef *def = Fetch::findDefMatch(target->getAsmString());
+        if(def == nullptr){
+          continue;
+        }
+
+        // the context may be shared with other modules
+        for(User *u : target->users()){
+          CallInst *site = dyn_cast<CallInst>(u);
+          if(site != nullptr && site->getCalledValue() == target &&
+              site->getModule() == &m){
+            addSite(site, def);
+          }
+        }
+      }
+    }
+  }
+}
@@ -10,6 +10,36 @@ struct FetchDef {
   int dst;
 };
 
+// the iterations of the innermost loop around a fetch, at iteration i the
+// fetch reads [start + i * step, start + i * step + size), with i up to
+// trips, the backedge-taken count of the loop
+struct LoopSummary {
+  Loop *loop;
+  const SCEV *start;
+  const SCEV *trips;
+  int64_t step;
+  uint64_t size;
+  bool nowrap;
+
+  LoopSummary()
+    : loop(nullptr), start(nullptr), trips(nullptr), 
+      step(0), size(0), nowrap(false) {}
+
+  uint64_t stride() {
+    return step < 0 ? uint64_t(0) - uint64_t(step) : uint64_t(step);
+  }
+
+  // no two iterations read overlapping ranges
+  bool isDisjoint() {
+    return loop != nullptr && nowrap && step != 0 && stride() >= size;
+  }
+
+  // the ranges of all iterations form a single range
+  bool isContiguous() {
+    return loop != nullptr && trips != nullptr && stride() <= size;
+  }
+};
+
 struct Fetch {
   // fields
   Instruction *inst;
@@ -18,6 +48,9 @@ struct Fetch {
   Value *len;
   Value *dst;
 
+  // set if the fetch is loop-carried
+  LoopSummary summary;
+
   // methods
   Fetch() {}
 
@@ -30,4 +63,31 @@ struct Fetch {
   static const FetchDef *findDefMatch(const string &name);
 };
 
+// module-wide index of fetch sites, grouped by their host functions
+class FetchIndex {
+  public:
+    FetchIndex(Module &m);
+
+    ~FetchIndex() {}
+
+    typedef vector<pair<CallInst *, const FetchDef *>> Sites;
+
+    Sites *getSites(Function *f) {
+      auto i = index.find(f);
+      if(i == index.end()){
+        return nullptr;
+      } else {
+        return &i->second;
+      }
+    }
+
+  protected:
+    void addSite(CallInst *ci, const FetchDef *def) {
+      index[ci->getFunction()].push_back(make_pair(ci, def));
+    }
+
+  protected:
+    map<Function *, Sites> index;
+};
+
 #endif /* FETCH_H_ */
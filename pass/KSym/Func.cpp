@@ -6,36 +6,106 @@ static inline Value *getCallArgOrRet(CallInst *ci, int idx) {
   return idx >= 0 ? ci->getArgOperand(idx) : ci;
 }
 
+// option setup
+static cl::opt<unsigned> TRACE_JOBS("ksym-trace-threads", cl::init(1),
+    cl::desc("number of traces of a function to check in parallel"));
+
+static cl::opt<unsigned> FUNC_BUDGET("ksym-func-budget", cl::init(0),
+    cl::desc("seconds to spend on a function, 0 for unlimited"));
+
+static cl::opt<unsigned> FETCH_BUDGET("ksym-fetch-budget", cl::init(0),
+    cl::desc("seconds to spend on checking the traces of a fetch, "
+      "0 for unlimited"));
+
+static cl::opt<bool> TRACE_TRIE("ksym-trace-trie", cl::init(false),
+    cl::desc("symbolize the common prefixes of the traces of a fetch once"));
+
+static cl::opt<unsigned> PATH_LIMIT("ksym-path-limit", cl::init(0),
+    cl::desc("traces of a fetch to check in full, 0 for unlimited"));
+
+enum PathPolicy {
+  PATH_SAMPLE,
+  PATH_DEFER,
+  PATH_MERGE
+};
+
+static cl::opt<PathPolicy> PATH_POLICY("ksym-path-policy", 
+    cl::init(PATH_SAMPLE),
+    cl::desc("what to do with a fetch having more traces than the limit"),
+    cl::values(
+      clEnumValN(PATH_SAMPLE, "sample", "check the first traces only"),
+      clEnumValN(PATH_DEFER, "defer", "skip the fetch"),
+      clEnumValN(PATH_MERGE, "merge", 
+        "check all traces at once if loop-free, otherwise sample")));
+
+static cl::opt<bool> STOP_DECIDED("ksym-stop-decided", cl::init(true),
+    cl::desc("stop checking a fetch once all its pairs are proven SAT"));
+
+static cl::opt<bool> LOOP_SUMMARY("ksym-loop-summary", cl::init(true),
+    cl::desc("check the iterations of a loop-carried fetch as one range"));
+
 // collection
 void FuncHandle::collectFetch() {
-  for(BasicBlock &bb : func){
-    for(Instruction &i : bb){
-      if(CallInst *ci = dyn_cast<CallInst>(&i)){
-        const FetchDef *def;
-
-        if(ci->isInlineAsm()){
-          InlineAsm *target = cast<InlineAsm>(ci->getCalledValue());
-          def = Fetch::findDefMatch(target->getAsmString());
-        } else {
-          Function *target = ci->getCalledFunction();
-          if(target == nullptr){
-            // TODO handle indirect call
-            def = nullptr;
-          } else {
-            def = Fetch::findDefMatch(target->getName().str());
-          }
-        }
+  for(auto const &i : sites){
+    CallInst *ci = i.first;
+    const FetchDef *def = i.second;
 
-        if(def != nullptr){
-          Fetch *fetch = new Fetch(ci,
-              getCallArgOrRet(ci, def->src),
-              getCallArgOrRet(ci, def->len),
-              getCallArgOrRet(ci, def->dst));
+    Fetch *fetch = new Fetch(ci,
+        getCallArgOrRet(ci, def->src),
+        getCallArgOrRet(ci, def->len),
+        getCallArgOrRet(ci, def->dst));
 
-          fts.insert(make_pair(ci, fetch));
-        }
-      }
+    if(LOOP_SUMMARY.getValue()){
+      summarizeFetch(fetch);
     }
+
+    fts.insert(make_pair(ci, fetch));
+  }
+}
+
+void FuncHandle::summarizeFetch(Fetch *fetch) {
+  Loop *loop = fo.getLoopInfo().getLoopFor(fetch->inst->getParent());
+  if(loop == nullptr){
+    return;
+  }
+
+  lock_guard<mutex> guard(FuncOracle::getSCEVLock());
+  ScalarEvolution &se = fo.getScalarEvolution();
+  if(!se.isSCEVable(fetch->src->getType()) || 
+      !se.isSCEVable(fetch->len->getType())){
+    return;
+  }
+
+  // affine addresses with a constant stride and a constant length only
+  const SCEVAddRecExpr *rec = 
+    dyn_cast<SCEVAddRecExpr>(se.getSCEV(fetch->src));
+
+  if(rec == nullptr || rec->getLoop() != loop || !rec->isAffine()){
+    return;
+  }
+
+  const SCEVConstant *step = 
+    dyn_cast<SCEVConstant>(rec->getStepRecurrence(se));
+  const SCEVConstant *size = 
+    dyn_cast<SCEVConstant>(se.getSCEV(fetch->len));
+
+  if(step == nullptr || size == nullptr){
+    return;
+  }
+
+  // keep only the expressions, which are immutable and safe to read 
+  // without the lock
+  LoopSummary &sum = fetch->summary;
+  sum.loop = loop;
+  sum.start = rec->getStart();
+  sum.step = step->getAPInt().getSExtValue();
+  sum.size = size->getAPInt().getZExtValue();
+  sum.nowrap = rec->hasNoSelfWrap() || 
+    rec->hasNoUnsignedWrap() || rec->hasNoSignedWrap();
+
+  const SCEV *trips = se.getBackedgeTakenCount(loop);
+  if(!isa<SCEVCouldNotCompute>(trips)){
+    sum.trips = trips;
   }
 }
 
@@ -48,8 +118,117 @@ Fetch *FuncHandle::getFetchFromInst(Instruction *inst) {
   }
 }
 
+// filtering
+void FuncHandle::filterFetch() {
+  for(auto &i : fts){
+    Fetch *fetch = i.second;
+    BasicBlock *host = fetch->inst->getParent();
+
+    BlockSet reach = fo.getReachBlocks(host);
+
+    for(auto &j : fts){
+      bool pairable;
+
+      if(j.second == fetch){
+        // the fetch itself, only when it sits on a cycle
+        pairable = false;
+
+        succ_iterator si = succ_begin(host), se = succ_end(host);
+        for(; si != se; ++si){
+          if(reach.contains(*si)){
+            pairable = true;
+            break;
+          }
+        }
+
+        // all cycles are iterations of a single loop, which never read 
+        // the same byte twice
+        LoopSummary &sum = fetch->summary;
+        if(pairable && sum.isDisjoint() && !isReentered(sum.loop)){
+
+          pairable = false;
+          record.add(fetch, fetch, CK_UNSAT);
+          record.summarized++;
+
+          if(sum.isContiguous() && isAlone(fetch) && 
+              !hasLiveOut(sum.loop)){
+            summarized.insert(sum.loop);
+          }
+        }
+      } else {
+        pairable = reach.contains(j.second->inst->getParent());
+      }
+
+      if(pairable){
+        cands[fetch].insert(j.second);
+      }
+    }
+  }
+}
+
+bool FuncHandle::isReentered(Loop *loop) {
+  BlockSet reach = fo.getReachBlocks(loop->getHeader());
+
+  SmallVector<BasicBlock *, 8> exits;
+  loop->getExitBlocks(exits);
+
+  for(BasicBlock *e : exits){
+    if(reach.contains(e)){
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool FuncHandle::isAlone(Fetch *fetch) {
+  for(auto &i : fts){
+    if(i.second != fetch && fetch->summary.loop->contains(i.first)){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool FuncHandle::hasLiveOut(Loop *loop) {
+  for(BasicBlock *bb : loop->blocks()){
+    for(Instruction &i : *bb){
+      for(User *u : i.users()){
+        Instruction *ui = dyn_cast<Instruction>(u);
+        if(ui != nullptr && !loop->contains(ui)){
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+bool FuncHandle::allDecided(Fetch *fetch) {
+  auto i = cands.find(fetch);
+  assert(i != cands.end());
+
+  for(Fetch *other : i->second){
+    if(!isDecided(fetch, other)){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// handle
+FuncHandle::FuncHandle(Function &f, ModuleOracle &m, 
+    FetchIndex::Sites &s)
+  : func(f), sites(s), 
+    mo(m), fo(f, m.getDataLayout(), m.getTargetLibraryInfo()),
+    budget(uint64_t(FUNC_BUDGET.getValue()) * 1000) 
+{}
+
 // result collection
-void FuncHandle::addResult(Fetch *f1, Fetch *f2, CheckResult res) {
+void CheckRecord::add(Fetch *f1, Fetch *f2, CheckResult res) {
   auto k = make_pair(f1, f2);
   auto i = result.find(k);
 
@@ -60,7 +239,7 @@ void FuncHandle::addResult(Fetch *f1, Fetch *f2, CheckResult res) {
 
   // if in higher rank, override
   else if(res < i->second){ 
-    result.insert(make_pair(k, res));
+    i->second = res;
   }
 
   // if error, also record
@@ -69,7 +248,23 @@ void FuncHandle::addResult(Fetch *f1, Fetch *f2, CheckResult res) {
   }
 }
 
-unsigned FuncHandle::countResult(CheckResult res) {
+void CheckRecord::merge(CheckRecord &other) {
+  // ranks are order-independent, so the merged result is deterministic
+  for(auto &i : other.result){
+    add(i.first.first, i.first.second, i.second);
+  }
+
+  failed.insert(other.failed.begin(), other.failed.end());
+  expired.insert(other.expired.begin(), other.expired.end());
+  skipped += other.skipped;
+  presolved += other.presolved;
+  solved += other.solved;
+  summarized += other.summarized;
+  collapsed += other.collapsed;
+  except = except || other.except;
+}
+
+unsigned CheckRecord::count(CheckResult res) {
   unsigned count = 0;
 
   for(auto &i : result){
@@ -81,49 +276,114 @@ unsigned FuncHandle::countResult(CheckResult res) {
   return count;
 }
 
-// analysis
-void FuncHandle::analyzeFetch(Fetch &fetch) {
-#ifdef KSYM_DEBUG
-  SLOG.log("inst", Helper::getValueRepr(fetch.inst));
-  SLOG.log("host", Helper::getValueName(fetch.inst->getParent()));
-#endif
-
+// per-fetch preparation
+FetchContext::FetchContext(FuncOracle &fo, Fetch &fetch, 
+    set<Loop *> &loops) : spent(0) {
   // collect reachable blocks
-  set<BasicBlock *> reach;
-  fo.getReachBlocks(fetch.inst->getParent(), reach);
+  reach = fo.getReachBlocks(fetch.inst->getParent());
 
   // create a slice
-  Slice slice(reach, fetch.inst);
+  slice = new Slice(reach, fo.getDepIndex(), fetch.inst);
 
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_DRAW)
   SLOG.map("slice");
-  Record::CFG(slice, SLOG);
+  Record::CFG(*slice, SLOG);
   SLOG.pop();
 #endif
 
   // construct analysis
-  LLVMSlice wrap(&slice);
-  SliceOracle oracle(wrap);
+  wrap = new LLVMSlice(slice);
+  oracle = new SliceOracle(*wrap);
+
+  for(Loop *loop : loops){
+    oracle->addSummarizedLoop(loop);
+  }
+
+  // unrolled on demand
+  unrolled = nullptr;
+
+  plan = PLAN_FULL;
+}
 
-  // unroll
-  UnrollPath *unrolled = oracle.getUnrolled(&wrap.getBasisBlock());
+// planning
+FetchPlan FuncHandle::planFetch(Fetch &fetch, FetchContext &ctx) {
+  uint64_t limit = PATH_LIMIT.getValue();
+  if(limit == 0){
+    return PLAN_FULL;
+  }
+
+  uint64_t count = ctx.estimatePaths();
 
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_STAT)
   errs() 
     << func.getName() 
     << "::" << "fetch " << &fetch 
-    << "::" << unrolled->size() << " traces" 
+    << "::" << count << " traces estimated" 
     << "\n";
 #endif
 
+  if(count <= limit){
+    return PLAN_FULL;
+  }
+
+  switch(PATH_POLICY.getValue()){
+    case PATH_DEFER:
+      return PLAN_DEFER;
+
+    case PATH_MERGE:
+      {
+        // loops are left to the unrolling
+        blist blks;
+        return ctx.getRegion(blks) ? PLAN_MERGE : PLAN_SAMPLE;
+      }
+
+    default:
+      return PLAN_SAMPLE;
+  }
+}
+
+// analysis
+void FuncHandle::analyzeFetch(Fetch &fetch) {
+#ifdef KSYM_DEBUG
+  SLOG.log("inst", Helper::getValueRepr(fetch.inst));
+  SLOG.log("host", Helper::getValueName(fetch.inst->getParent()));
+#endif
+
+  // slice
+  FetchContext ctx(fo, fetch, summarized);
+  FetchPlan plan = planFetch(fetch, ctx);
+  ctx.setPlan(plan);
+
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_FUNC)
   SLOG.vec("check");
 #endif
 
-  // per-trace analysis
-  UnrollPath::iterator it = unrolled->begin(), ie = unrolled->end();
-  for(; it != ie; ++it){
-    analyzeFetchPerTrace(fetch, oracle, *(*it));
+  // per-trace analysis, fetches left unchecked or checked in part are
+  // reported along with the timed-out ones
+  if(plan == PLAN_DEFER){
+    record.expired.insert(&fetch);
+  } else if(plan == PLAN_MERGE){
+    analyzeFetchMerged(fetch, ctx, record);
+  } else if(plan == PLAN_FULL && TRACE_TRIE.getValue()){
+    analyzeFetchOnTrie(fetch, ctx, record);
+  } else {
+    // traces are unrolled one at a time, so that the enumeration stops
+    // along with the checking
+    UnrollGen gen = ctx.getUnrollGen();
+
+    unsigned count = 0;
+    blist blks;
+
+    while(gen.next(blks)){
+      if(plan == PLAN_SAMPLE && count++ >= PATH_LIMIT.getValue()){
+        record.expired.insert(&fetch);
+        break;
+      }
+
+      if(!analyzeTraceInBudget(fetch, ctx, blks, record)){
+        break;
+      }
+    }
   }
 
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_FUNC)
@@ -131,6 +391,138 @@ void FuncHandle::analyzeFetch(Fetch &fetch) {
 #endif
 }
 
+void FuncHandle::analyzeFetchParallel(unsigned num) {
+  // slice and unroll all fetches first, these are cheap compared with the
+  // symbolic checking and are not safe to share with the workers anyway
+  vector<FetchContext *> ctxs;
+  vector<TraceWork> works;
+
+  // sampled traces are not owned by the oracles
+  BlockTrace::Pool samples;
+
+  for(auto &i : fts){
+    Fetch *fetch = i.second;
+
+    if(cands.find(fetch) == cands.end()){
+      continue;
+    }
+
+    if(budget.expired()){
+      record.expired.insert(fetch);
+      continue;
+    }
+
+    FetchContext *ctx = new FetchContext(fo, *fetch, summarized);
+    ctxs.push_back(ctx);
+
+    FetchPlan plan = planFetch(*fetch, *ctx);
+    ctx->setPlan(plan);
+
+    if(plan == PLAN_DEFER){
+      record.expired.insert(fetch);
+      continue;
+    }
+
+    if(plan == PLAN_SAMPLE){
+      UnrollGen gen = ctx->getUnrollGen();
+
+      unsigned count = 0;
+      blist blks;
+
+      while(gen.next(blks)){
+        if(count++ >= PATH_LIMIT.getValue()){
+          record.expired.insert(fetch);
+          break;
+        }
+
+        BlockTrace trace;
+        for(LLVMSliceBlock *b : blks){
+          trace = trace.extend(b, samples);
+        }
+
+        works.push_back(TraceWork(fetch, ctx, trace));
+      }
+
+      continue;
+    }
+
+    // the merged traces or the trie of a fetch are checked by a single 
+    // worker
+    if(plan == PLAN_MERGE || TRACE_TRIE.getValue()){
+      works.push_back(TraceWork(fetch, ctx, BlockTrace()));
+      continue;
+    }
+
+    UnrollPath *unrolled = ctx->getUnrolled();
+    UnrollPath::iterator it = unrolled->begin(), ie = unrolled->end();
+    for(; it != ie; ++it){
+      works.push_back(TraceWork(fetch, ctx, *it));
+    }
+  }
+
+  // check all traces, each worker builds its own SEG and symbol engine
+  num = std::min<unsigned>(num, works.size());
+
+  if(num != 0){
+    vector<CheckRecord> recs(num);
+
+    TraceSched sched(num, works.size());
+    sched.run([&](unsigned wid, unsigned idx) {
+      TraceWork &w = works[idx];
+      if(w.trace.empty() && w.ctx->getPlan() == PLAN_MERGE){
+        analyzeFetchMerged(*w.fetch, *w.ctx, recs[wid]);
+      } else if(w.trace.empty()){
+        analyzeFetchOnTrie(*w.fetch, *w.ctx, recs[wid]);
+      } else {
+        blist blks;
+        w.trace.appendTo(blks);
+        analyzeTraceInBudget(*w.fetch, *w.ctx, blks, recs[wid]);
+      }
+    });
+
+    for(CheckRecord &rec : recs){
+      record.merge(rec);
+    }
+  }
+
+  for(FetchContext *ctx : ctxs){
+    delete ctx;
+  }
+}
+
+bool FuncHandle::isTraceNeeded(Fetch &fetch, FetchContext &ctx,
+    CheckRecord &rec) {
+
+  // the rest of the traces are dropped once over budget, which leaves the
+  // pairs only checked in dropped traces undecided
+  uint64_t limit = uint64_t(FETCH_BUDGET.getValue()) * 1000;
+  if(budget.expired() || (limit != 0 && ctx.getSpent() >= limit)){
+    rec.expired.insert(&fetch);
+    return false;
+  }
+
+  // no trace can change the results any more
+  if(STOP_DECIDED.getValue() && allDecided(&fetch)){
+    return false;
+  }
+
+  return true;
+}
+
+bool FuncHandle::analyzeTraceInBudget(Fetch &fetch, FetchContext &ctx,
+    blist &blks, CheckRecord &rec) {
+
+  if(!isTraceNeeded(fetch, ctx, rec)){
+    return false;
+  }
+
+  Budget timer(0);
+  analyzeFetchPerTrace(fetch, ctx, blks, rec);
+  ctx.charge(timer.elapsed());
+
+  return true;
+}
+
 static inline void blistToIlist(blist &bl, Instruction *stop, iseq &il) {
   for(LLVMSliceBlock *bb : bl){
     LLVMSliceBlock::inst_iterator i = bb->inst_begin(), ie = bb->inst_end();
@@ -159,31 +551,237 @@ static inline void dumpValueSymbol(Value *val, SEGraph &seg, SymExec &sym) {
 }
 #endif
 
-void FuncHandle::analyzeFetchPerTrace(Fetch &fetch, SliceOracle &so, 
-    blist &blks) {
+// the symbols are created for the caller to own
+static SymVar *createSymbol(Z3_ast ast) {
+  SymExpr expr;
+  SymCond cond;
+  expr.expr = ast;
+
+  SymVar *var = new SymVar();
+  var->add(new SymVal(expr, cond));
+  return var;
+}
+
+// the range read over all iterations of a loop-carried fetch, in place of
+// the range of the iteration on the trace, with the trip count taken from
+// the backedge-taken count, over values defined before the loop, which the
+// trace leaves unpinned as it does not assert the exit condition
+static bool summarizeRange(Fetch &fetch, SEGraph &seg, SymExec &sym,
+    vector<SymVar *> &owned, SymVar *&src, SymVar *&len) {
+
+  LoopSummary &sum = fetch.summary;
+  if(!sum.isContiguous()){
+    return false;
+  }
+
+  Z3_ast start = seg.symbolizeSCEV(sym, sum.start);
+  Z3_ast trips = seg.symbolizeSCEV(sym, sum.trips);
+  if(start == nullptr || trips == nullptr || !sym.isPointerSort(start)){
+    return false;
+  }
+
+  Z3_context ctxt = sym.getContext();
+
+  unsigned pw = sym.getOracle().getPointerWidth();
+  unsigned tw = sym.getExprSortWidth(trips);
+  if(tw < pw){
+    trips = sym.castMachIntZExt(trips, pw);
+  } else if(tw > pw){
+    trips = sym.castMachIntTrunc(trips, pw);
+  }
+
+  Z3_ast span = Z3_mk_bvmul(ctxt, trips, sym.createConstPointer(sum.stride()));
+
+  src = createSymbol(sum.step > 0 ? start : Z3_mk_bvsub(ctxt, start, span));
+  len = createSymbol(
+      Z3_mk_bvadd(ctxt, span, sym.createConstPointer(sum.size)));
+
+  owned.push_back(src);
+  owned.push_back(len);
+  return true;
+}
+
+bool FuncHandle::hasPending(Fetch &fetch, iseq &trace) {
+  for(unsigned c = 0; c + 1 < trace.size(); c++){
+    Fetch *other = getFetchFromInst(trace.at(c));
+    if(other != nullptr && !isDecided(&fetch, other)){
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void FuncHandle::crossCheck(Fetch &fetch, SEGraph &seg, SymExec &sym,
+    iseq &trace, CheckRecord &rec) {
+
+  int len = trace.size() - 1;
+
+  SENode *fsrc = seg.getNodeOrFail(len, fetch.src);
+  SENode *flen = seg.getNodeOrFail(len, fetch.len);
+
+  // collect the pairs not yet proven
+  vector<int> seqs;
+  vector<Fetch *> pairs;
+  vector<pair<SymVar *, SymVar *>> ranges;
+
+  // in a merged graph, each of the other fetches only happens on the paths
+  // through its block
+  vector<Z3_ast> conds;
+
+  // summarized ranges
+  vector<SymVar *> owned;
+
+  for(int c = 0; c < len; c++){
+    Instruction *i = trace.at(c);
+
+    // check if the inst is in SEG
+    SENode *node = seg.getNodeOrNull(c, i);
+    if(node == nullptr){
+      continue;
+    }
+
+    // check if the inst is another fetch
+    Fetch *other = getFetchFromInst(i);
+    if(other == nullptr){
+      continue;
+    }
+
+    // skip the pairs that are already proven
+    if(isDecided(&fetch, other)){
+      continue;
+    }
+
+    SENode *osrc = seg.getNodeOrFail(c, other->src);
+    SENode *olen = seg.getNodeOrFail(c, other->len);
+
+    SymVar *os = sym.getVar(osrc), *ol = sym.getVar(olen);
+
+    // a loop-carried fetch left before the fetch is checked over all its 
+    // iterations at once, as the trace leaves out its exit condition
+    Loop *loop = other->summary.loop;
+    if(summarized.count(loop) != 0 && !loop->contains(fetch.inst)){
+      summarizeRange(*other, seg, sym, owned, os, ol);
+    }
+
+    seqs.push_back(c);
+    pairs.push_back(other);
+    ranges.push_back(make_pair(os, ol));
+
+    if(seg.isMerged()){
+      conds.push_back(seg.getGuard(sym, c));
+    }
+  }
+
+  if(pairs.empty()){
+    return;
+  }
+
+  // so is the fetch, its loop holds none of the others
+  SymVar *fs = sym.getVar(fsrc), *fl = sym.getVar(flen);
+
+  if(summarized.count(fetch.summary.loop) != 0){
+    summarizeRange(fetch, seg, sym, owned, fs, fl);
+  }
+
+  // check fetch correlation
+  unsigned presolved = sym.getPresolved(), solved = sym.getSolved();
+
+  vector<CheckResult> results;
+  vector<Z3_model> models;
+
+#if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_DUMP)
+  // the model of each SAT pair, for replaying the trace
+  sym.checkOverlaps(fs, fl, ranges, conds, results, &models);
+#else
+  sym.checkOverlaps(fs, fl, ranges, conds, results);
+#endif
+
+  for(SymVar *var : owned){
+    delete var;
+  }
+
+  rec.presolved += sym.getPresolved() - presolved;
+  rec.solved += sym.getSolved() - solved;
+
+  for(unsigned k = 0; k < pairs.size(); k++){
+    Fetch *other = pairs[k];
+    CheckResult res = results[k];
+
+    rec.add(&fetch, other, res);
+
+    if(res == CK_SAT){
+      setDecided(&fetch, other);
+    }
+
+#if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_DUMP)
+    // log the trace for a potential bug
+    if(res == CK_SAT){
+      SLOG.map();
+
+      SLOG.log("seq", seqs[k]);
+      SLOG.log("tar", Helper::getValueRepr(other->inst));
+
+      SLOG.map("dfbug");
+      SLOG.log("src1", Helper::getValueRepr(fetch.src));
+      SLOG.log("len1", Helper::getValueRepr(fetch.len));
+      SLOG.log("src2", Helper::getValueRepr(other->src));
+      SLOG.log("len2", Helper::getValueRepr(other->len));
+      SLOG.pop();
+
+      SLOG.vec("trace");
+      seg.replay(sym, models[k]); 
+      SLOG.pop();
+
+      SLOG.pop();
+    }
+#endif
+  }
+
+  for(Z3_model model : models){
+    sym.releaseModel(model);
+  }
+}
+
+void FuncHandle::analyzeFetchPerTrace(Fetch &fetch, FetchContext &ctx, 
+    blist &blks, CheckRecord &rec) {
 
   // convert to inst list
   iseq trace;
   blistToIlist(blks, fetch.inst, trace);
 
+  // CK_SAT is the top rank, so skip the trace if all the pairs it carries
+  // are already proven, or if it does not carry any
+  if(!hasPending(fetch, trace)){
+    rec.skipped++;
+    return;
+  }
+
 	// CHENXIONG: start
 	/*
 	PA *pa = new PA();
-	pa->analyzePointTo(trace, so);
+	pa->analyzePointTo(trace, ctx.getOracle());
 	delete pa;
 	*/
 	// CHENXIONG: end
 
   try {
     // create SEG
-    SEGraph seg(so, trace);
+    SEGraph seg(ctx.getOracle(), trace);
+
+    // traces differing only in the trimmed parts are checked once
+    SEGraph::Shape shape;
+    seg.getShape(shape);
 
-    iseq filt;
-    seg.filterTrace(filt);
+    if(!ctx.addShape(shape)){
+      rec.collapsed++;
+      return;
+    }
     //Node::analyzePointTo(trace);
 
-    // create symbol engine
-    SymExec sym(mo);
+    // borrow the symbol engine of the worker
+    SymLease lease(mo);
+    SymExec &sym = lease.get();
 
     // symbolize the SEG
     seg.symbolize(sym);
@@ -198,66 +796,169 @@ void FuncHandle::analyzeFetchPerTrace(Fetch &fetch, SliceOracle &so,
 #endif
 
     // fetch cross-checking
-    int len = trace.size() - 1;
+    crossCheck(fetch, seg, sym, trace, rec);
+  } catch(KSymError &e) {
+    rec.except = true;
+  }
+}
 
-    SENode *fsrc = seg.getNodeOrFail(len, fetch.src);
-    SENode *flen = seg.getNodeOrFail(len, fetch.len);
+// merged analysis
+void FuncHandle::analyzeFetchMerged(Fetch &fetch, FetchContext &ctx,
+    CheckRecord &rec) {
 
-    Fetch *other;
-    SENode *osrc, *olen;
-    CheckResult res;
+  blist blks;
+  bool acyclic = ctx.getRegion(blks);
+  assert(acyclic);
 
-    for(int c = 0; c < len; c++){
-      Instruction *i = trace.at(c);
+#if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_STAT)
+  errs() 
+    << func.getName() 
+    << "::" << "fetch " << &fetch 
+    << "::" << blks.size() << " merged blocks" 
+    << "\n";
+#endif
 
-      // check if the inst is in SEG
-      SENode *node = seg.getNodeOrNull(c, i);
-      if(node == nullptr){
-        continue;
-      }
+  if(!isTraceNeeded(fetch, ctx, rec)){
+    return;
+  }
 
-      // check if the inst is another fetch
-      other = getFetchFromInst(i);
-      if(other == nullptr){
-        continue;
+  // the blocks of the region in a topological order, one SEG and one 
+  // symbol engine for all of them
+  iseq trace;
+  blistToIlist(blks, fetch.inst, trace);
+
+  if(!hasPending(fetch, trace)){
+    rec.skipped++;
+    return;
+  }
+
+  Budget timer(0);
+
+  try {
+    SEGraph seg(ctx.getOracle(), trace, blks);
+
+    SymLease lease(mo);
+    SymExec &sym = lease.get();
+
+    seg.symbolize(sym);
+    crossCheck(fetch, seg, sym, trace, rec);
+  } catch(KSymError &e) {
+    rec.except = true;
+  }
+
+  ctx.charge(timer.elapsed());
+}
+
+// shared-prefix analysis
+static inline void appendBlock(LLVMSliceBlock *bb, Instruction *stop, 
+    iseq &il) {
+
+  LLVMSliceBlock::inst_iterator i = bb->inst_begin(), ie = bb->inst_end();
+  for(; i != ie; ++i){
+    il.push_back(*i);
+    if(*i == stop){
+      break;
+    }
+  }
+}
+
+void FuncHandle::analyzeFetchOnTrie(Fetch &fetch, FetchContext &ctx,
+    CheckRecord &rec) {
+
+  UnrollTrie trie(ctx.getUnrolled());
+
+#if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_STAT)
+  errs() 
+    << func.getName() 
+    << "::" << "fetch " << &fetch 
+    << "::" << trie.size() << " trie blocks" 
+    << "\n";
+#endif
+
+  // one SEG and one symbol engine follow the walk, growing on the way down
+  // and retracting on the way up
+  iseq trace;
+  SEGraph seg(ctx.getOracle(), trace, true);
+
+  SymLease lease(mo);
+  SymExec &sym = lease.get();
+
+  Budget timer(0);
+  analyzeTrieNode(fetch, ctx, trie.getRoot(), 0, trace, seg, sym, 
+      timer, rec);
+  ctx.charge(timer.elapsed());
+}
+
+bool FuncHandle::analyzeTrieNode(Fetch &fetch, FetchContext &ctx,
+    UnrollTrie::Node *node, int from, iseq &trace, SEGraph &seg, 
+    SymExec &sym, Budget &timer, CheckRecord &rec) {
+
+  for(UnrollTrie::Node *child : node->children){
+    unsigned mark = trace.size();
+
+    // a trace ends at the fetch
+    if(child->term){
+      ctx.charge(timer.elapsed());
+      timer = Budget(0);
+
+      if(!isTraceNeeded(fetch, ctx, rec)){
+        return false;
       }
 
-      // check fetch correlation
-      osrc = seg.getNodeOrFail(c, other->src);
-      olen = seg.getNodeOrFail(c, other->len);
+      appendBlock(child->block, fetch.inst, trace);
 
-      res = sym.checkOverlap(
-          sym.getVar(fsrc), sym.getVar(flen),
-          sym.getVar(osrc), sym.getVar(olen));
+      if(!hasPending(fetch, trace)){
+        rec.skipped++;
+      } else {
+        sym.push();
 
-      addResult(&fetch, other, res);
+        try {
+          seg.symbolize(sym, from, seg.extend(from));
+          sym.complete();
+          crossCheck(fetch, seg, sym, trace, rec);
+        } catch(KSymError &e) {
+          rec.except = true;
+        }
 
-#if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_DUMP)
-      // log the trace for a potential bug
-      if(res == CK_SAT){
-        SLOG.map();
+        sym.pop();
+        seg.retract(from);
+      }
 
-        SLOG.log("seq", c);
-        SLOG.log("tar", Helper::getValueRepr(other->inst));
+      trace.resize(mark);
+    }
 
-        SLOG.map("dfbug");
-        SLOG.log("src1", Helper::getValueRepr(fsrc->getVal()));
-        SLOG.log("len1", Helper::getValueRepr(flen->getVal()));
-        SLOG.log("src2", Helper::getValueRepr(osrc->getVal()));
-        SLOG.log("len2", Helper::getValueRepr(olen->getVal()));
-        SLOG.pop();
+    // traces passing through the block
+    if(!child->children.empty()){
+      appendBlock(child->block, nullptr, trace);
 
-        SLOG.vec("trace");
-        seg.replay(sym); 
-        SLOG.pop();
+      bool ok = true, cont = true;
+      sym.push();
 
-        SLOG.pop();
+      int next = from;
+      try {
+        next = seg.extend(from);
+        seg.symbolize(sym, from, next);
+      } catch(KSymError &e) {
+        rec.except = true;
+        ok = false;
+      }
+
+      if(ok){
+        cont = analyzeTrieNode(fetch, ctx, child, next, trace, seg, sym,
+            timer, rec);
+      }
+
+      sym.pop();
+      seg.retract(from);
+      trace.resize(mark);
+
+      if(!cont){
+        return false;
       }
-#endif
     }
-  } catch(KSymError &e) {
-    EXCEPT.insert(fetch.inst->getParent()->getParent());
   }
+
+  return true;
 }
 
 // entry point
@@ -271,45 +972,84 @@ void FuncHandle::run() {
   // collect fetches first 
   collectFetch();
 
+  // the slicing and checking are only needed for fetches with a potential
+  // predecessor fetch, the other fetches only serve as such predecessors
+  filterFetch();
+
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_STAT)
   if(!fts.empty()){
     errs() 
       << func.getName() 
       << "::" << fts.size() << " fetches" 
+      << "::" << cands.size() << " candidates" 
       << "\n";
   }
 #endif
 
   // analyze each fetch
 #ifdef KSYM_DEBUG
-  SLOG.vec("fetch");
+  // the log is structured per fetch, keep it serial in debug builds
+  unsigned num = 1;
+#else
+  unsigned num = TRACE_JOBS.getValue();
 #endif
 
-  for(auto &i : fts){
+  if(num > 1){
+    analyzeFetchParallel(num);
+  } else {
 #ifdef KSYM_DEBUG
-    SLOG.map();
+    SLOG.vec("fetch");
 #endif
 
-    analyzeFetch(*i.second);
+    for(auto &i : fts){
+      if(cands.find(i.second) == cands.end()){
+        continue;
+      }
 
 #ifdef KSYM_DEBUG
-    SLOG.pop();
+      SLOG.map();
 #endif
-  }
+
+      if(budget.expired()){
+        record.expired.insert(i.second);
+      } else {
+        analyzeFetch(*i.second);
+      }
 
 #ifdef KSYM_DEBUG
-  SLOG.pop();
+      SLOG.pop();
 #endif
+    }
+
+#ifdef KSYM_DEBUG
+    SLOG.pop();
+#endif
+  }
+
+  // failures are reported on the thread owning the function
+  if(record.except){
+    EXCEPT.insert(&func);
+  }
+
+  if(!record.expired.empty()){
+    TIMEOUT.insert(&func);
+  }
 
 #if defined(KSYM_DEBUG) && defined(KSYM_DEBUG_FUNC)
   // log results 
   SLOG.map("result");
 
-  SLOG.log("total", result.size());
-  SLOG.log("error", failed.size());
-  SLOG.log("sat", countResult(CK_SAT));
-  SLOG.log("uns", countResult(CK_UNSAT));
-  SLOG.log("udf", countResult(CK_UNDEF));
+  SLOG.log("total", record.result.size());
+  SLOG.log("error", record.failed.size());
+  SLOG.log("sat", record.count(CK_SAT));
+  SLOG.log("uns", record.count(CK_UNSAT));
+  SLOG.log("udf", record.count(CK_UNDEF));
+  SLOG.log("timeout", record.expired.size());
+  SLOG.log("skipped", record.skipped);
+  SLOG.log("presolved", record.presolved);
+  SLOG.log("solved", record.solved);
+  SLOG.log("summarized", record.summarized);
+  SLOG.log("collapsed", record.collapsed);
 
   SLOG.pop();
 #endif
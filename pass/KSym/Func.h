@@ -3,17 +3,126 @@
 
 #include "Project.h"
 
+// how to check the traces of a fetch
+enum FetchPlan {
+  PLAN_FULL,
+  PLAN_SAMPLE,
+  PLAN_DEFER,
+  PLAN_MERGE
+};
+
+// per-fetch slicing and unrolling results
+class FetchContext {
+  public:
+    FetchContext(FuncOracle &fo, Fetch &fetch, set<Loop *> &loops);
+
+    ~FetchContext() {
+      delete oracle;
+      delete wrap;
+      delete slice;
+    }
+
+    SliceOracle &getOracle() {
+      return *oracle;
+    }
+
+    // all traces at once, unrolled on first request
+    UnrollPath *getUnrolled() {
+      if(unrolled == nullptr){
+        unrolled = oracle->getUnrolled(&wrap->getBasisBlock());
+      }
+
+      return unrolled;
+    }
+
+    // traces one at a time
+    UnrollGen getUnrollGen() {
+      return oracle->getUnrollGen(&wrap->getBasisBlock());
+    }
+
+    uint64_t estimatePaths() {
+      return oracle->estimatePaths(&wrap->getBasisBlock());
+    }
+
+    // all traces merged into one, false if they cannot be
+    bool getRegion(blist &blks) {
+      return oracle->getRegion(&wrap->getBasisBlock(), blks);
+    }
+
+    // false if a trace of the same shape has been checked already
+    bool addShape(SEGraph::Shape &shape) {
+      lock_guard<mutex> guard(slock);
+      return shapes.insert(shape).second;
+    }
+
+    void setPlan(FetchPlan p) {
+      plan = p;
+    }
+
+    FetchPlan getPlan() {
+      return plan;
+    }
+
+    // time spent on checking the traces, summed over all workers
+    void charge(uint64_t ms) {
+      spent += ms;
+    }
+
+    uint64_t getSpent() {
+      return spent;
+    }
+
+  protected:
+    // the slice refers to the reach set, so keep it alive
+    BlockSet reach;
+
+    Slice *slice;
+    LLVMSlice *wrap;
+    SliceOracle *oracle;
+
+    // owned by the oracle
+    UnrollPath *unrolled;
+
+    FetchPlan plan;
+
+    // budget usage
+    atomic<uint64_t> spent;
+
+    // shapes of the checked traces
+    mutex slock;
+    set<SEGraph::Shape> shapes;
+};
+
+// fetch cross-checking results, one per worker and merged at the end
+struct CheckRecord {
+  map<pair<Fetch *, Fetch *>, CheckResult> result;
+  set<pair<Fetch *, Fetch *>> failed;
+  set<Fetch *> expired;
+  unsigned skipped;
+  unsigned presolved;
+  unsigned solved;
+  unsigned summarized;
+  unsigned collapsed;
+  bool except;
+
+  CheckRecord() 
+    : skipped(0), presolved(0), solved(0), summarized(0), collapsed(0),
+      except(false) {}
+
+  void add(Fetch *f1, Fetch *f2, CheckResult res);
+  void merge(CheckRecord &other);
+  unsigned count(CheckResult res);
+};
+
 class FuncHandle {
   public:
-    FuncHandle(Function &f, ModuleOracle &m) 
-      : func(f), mo(m), fo(f, m.getDataLayout(), m.getTargetLibraryInfo()) 
-    {}
+    FuncHandle(Function &f, ModuleOracle &m, FetchIndex::Sites &s);
 
     ~FuncHandle() {
       for(auto const &i : fts){
         delete i.second;
       }
-    } 
+    }
 
     void run();
 
@@ -22,28 +131,98 @@ class FuncHandle {
     void collectFetch();
     Fetch *getFetchFromInst(Instruction *inst);
 
+    // describe the iterations of a fetch in a loop in closed form
+    void summarizeFetch(Fetch *fetch);
+
+    // collect, per fetch, the fetches that may precede it in an execution
+    void filterFetch();
+
+    // whether the loop can be entered again once left, through any cycle 
+    // of the function, including those loop info does not model
+    bool isReentered(Loop *loop);
+
+    // whether the loop of a summarized fetch holds no other fetch
+    bool isAlone(Fetch *fetch);
+
+    // whether a value defined in the loop is used past it
+    bool hasLiveOut(Loop *loop);
+
+    // pairs proven SAT, shared by all workers of the function
+    bool isDecided(Fetch *f1, Fetch *f2) {
+      lock_guard<mutex> guard(dlock);
+      return decided.find(make_pair(f1, f2)) != decided.end();
+    }
+
+    void setDecided(Fetch *f1, Fetch *f2) {
+      lock_guard<mutex> guard(dlock);
+      decided.insert(make_pair(f1, f2));
+    }
+
+    bool allDecided(Fetch *fetch);
+
+    // pick a plan from the number of traces of the fetch
+    FetchPlan planFetch(Fetch &fetch, FetchContext &ctx);
+
     // fetch analysis
     void analyzeFetch(Fetch &fetch);
-    void analyzeFetchPerTrace(Fetch &fetch, SliceOracle &so, blist &blks);
+    void analyzeFetchPerTrace(Fetch &fetch, FetchContext &ctx, blist &blks,
+        CheckRecord &rec);
+
+    // whether the trace contains a pair not yet proven SAT
+    bool hasPending(Fetch &fetch, iseq &trace);
+
+    // check the fetch against the preceding fetches in the trace
+    void crossCheck(Fetch &fetch, SEGraph &seg, SymExec &sym, iseq &trace,
+        CheckRecord &rec);
+
+    // false if the rest of the traces of the fetch can be dropped
+    bool isTraceNeeded(Fetch &fetch, FetchContext &ctx, CheckRecord &rec);
+
+    // run a trace within the function and fetch budgets, false if the rest
+    // of the traces of the fetch can be dropped
+    bool analyzeTraceInBudget(Fetch &fetch, FetchContext &ctx, blist &blks,
+        CheckRecord &rec);
 
-    // fetch results
-    void addResult(Fetch *f1, Fetch *f2, CheckResult res); 
-    unsigned countResult(CheckResult res);
+    // walk the trie of the unrolled traces, symbolizing each shared prefix
+    // only once
+    void analyzeFetchOnTrie(Fetch &fetch, FetchContext &ctx, 
+        CheckRecord &rec);
+    bool analyzeTrieNode(Fetch &fetch, FetchContext &ctx, 
+        UnrollTrie::Node *node, int from, iseq &trace, SEGraph &seg,
+        SymExec &sym, Budget &timer, CheckRecord &rec);
+
+    // check all traces of the fetch at once, merged at the join points
+    void analyzeFetchMerged(Fetch &fetch, FetchContext &ctx,
+        CheckRecord &rec);
+
+    // check all (fetch, trace) pairs of the function with multiple workers
+    void analyzeFetchParallel(unsigned num);
 
   protected:
     // context
     Function &func;
+    FetchIndex::Sites &sites;
 
     // oracle
     ModuleOracle &mo;
     FuncOracle fo;
 
+    // budget
+    Budget budget;
+
     // fetches
     map<Instruction *, Fetch *> fts;
-    
+    map<Fetch *, set<Fetch *>> cands;
+
+    // loops whose only fetch is checked over all iterations at once, with
+    // the exit condition left out of the traces
+    set<Loop *> summarized;
+
     // results
-    map<pair<Fetch *, Fetch *>, CheckResult> result;
-    set<pair<Fetch *, Fetch *>> failed;
+    CheckRecord record;
+
+    mutex dlock;
+    set<pair<Fetch *, Fetch *>> decided;
 };
 
 #endif /* FUNC_H_ */
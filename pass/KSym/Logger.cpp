@@ -66,6 +66,17 @@ void Logger::pop() {
   cur = stk.top();
 }
 
+void Logger::merge(Logger &other) {
+  assert(cur->is_object() && other.rec.is_object());
+
+  for(auto i = other.rec.begin(); i != other.rec.end(); ++i){
+    auto res = cur->emplace(i.key(), i.value());
+    assert(res.second);
+  }
+
+  other.rec = json::object();
+}
+
 void Logger::dump(raw_ostream &stm, int indent) {
   stm << rec.dump(indent);
 }
@@ -31,6 +31,9 @@ class Logger {
     // level - 1
     void pop();
 
+    // stay on same level, take over the top-level records of another logger
+    void merge(Logger &other);
+
     // dump to file
     void dump(raw_ostream &stm, int indent = 2);
     void dump(const string &fn, int indent = 2);
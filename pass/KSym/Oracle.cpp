@@ -1,20 +1,109 @@
 // SPDX-License-Identifier: MIT
 #include "Project.h"
 
+// layouts
+void ModuleOracle::prepareLayouts(Module &m) {
+  TypeFinder types;
+  types.run(m, false);
+
+  for(StructType *st : types){
+    if(st->isSized()){
+      dl.getStructLayout(st);
+    }
+  }
+}
+
+// analyses
+void FuncOracle::prepare() {
+  if(caa != nullptr){
+    return;
+  }
+
+  prepareLoops();
+  caa = new CombinedAA(dl, tli, *ac, *dt, *li);
+}
+
+void FuncOracle::prepareLoops() {
+  if(li != nullptr){
+    return;
+  }
+
+  ac = new AssumptionCache(func);
+  dt = new DominatorTree(func);
+  li = new LoopInfo(*dt);
+}
+
+mutex &FuncOracle::getSCEVLock() {
+  static mutex lock;
+  return lock;
+}
+
 // reachability
-void FuncOracle::getReachBlocks(BasicBlock *cur, set<BasicBlock *> &blks) {
-  if(blks.find(cur) != blks.end()){
+void FuncOracle::prepareReach() {
+  if(!blocks.empty()){
     return;
   }
 
-  blks.insert(cur);
+  for(BasicBlock &bb : func){
+    ids.insert(make_pair(&bb, blocks.size()));
+    blocks.push_back(&bb);
+  }
+
+  unsigned num = blocks.size();
+  reach.assign(num, BitVector(num));
+
+  for(unsigned i = 0; i < num; i++){
+    reach[i].set(i);
+  }
+
+  // visit in reverse post-order so that most sets settle in one round, 
+  // blocks unreachable from the entry come last
+  vector<unsigned> order;
+  vector<bool> seen(num, false);
+
+  ReversePostOrderTraversal<Function *> rpot(&func);
+  for(BasicBlock *bb : rpot){
+    unsigned i = ids[bb];
+    order.push_back(i);
+    seen[i] = true;
+  }
+
+  for(unsigned i = 0; i < num; i++){
+    if(!seen[i]){
+      order.push_back(i);
+    }
+  }
+
+  // the sets only grow, so a stable count means a fixpoint
+  bool changed = true;
+  while(changed){
+    changed = false;
+
+    for(unsigned i : order){
+      BitVector &cur = reach[i];
+      unsigned count = cur.count();
+
+      pred_iterator pi = pred_begin(blocks[i]), pe = pred_end(blocks[i]);
+      for(; pi != pe; ++pi){
+        cur |= reach[ids[*pi]];
+      }
 
-  pred_iterator pi = pred_begin(cur), pe = pred_end(cur);
-  for(; pi != pe; ++pi){
-    getReachBlocks(*pi, blks);
+      if(cur.count() != count){
+        changed = true;
+      }
+    }
   }
 }
 
+BlockSet FuncOracle::getReachBlocks(BasicBlock *cur) {
+  prepareReach();
+
+  auto i = ids.find(cur);
+  assert(i != ids.end());
+
+  return BlockSet(&blocks, &ids, &reach[i->second]);
+}
+
 // dominance
 LLVMSliceBlock *SliceOracle::getIDom(LLVMSliceBlock *bb) {
   SliceDomTreeNode *node = dt.getNode(bb);
@@ -42,3 +131,41 @@ LLVMSliceLoop *SliceOracle::getOuterLoopInScope(LLVMSliceLoop *scope,
 
   return c;
 }
+
+// merging
+bool SliceOracle::getRegion(LLVMSliceBlock *bb, blist &blks) {
+  DAItem *mark = dag.query(bb);
+  assert(mark != nullptr);
+
+  DAItem *root = dag.getRoot();
+
+  vector<DAItem *> order;
+  dag.topsort(mark, order);
+
+  // only the items reached from the root are on a trace
+  set<DAItem *> live;
+
+  for(DAItem *cur : order){
+    bool reached = cur == root;
+
+    DAItem::iterator pi = cur->predBegin(), pe = cur->predEnd();
+    for(; pi != pe && !reached; ++pi){
+      reached = live.find(*pi) != live.end();
+    }
+
+    if(!reached){
+      continue;
+    }
+
+    DABlock *block = dyn_cast<DABlock>(cur);
+    if(block == nullptr){
+      return false;
+    }
+
+    live.insert(cur);
+    blks.push_back(block->getBlock());
+  }
+
+  assert(!blks.empty() && blks.back() == bb);
+  return true;
+}
@@ -64,9 +64,41 @@ class SliceOracle {
       return uc.getUnrolled(path, bb, &dag);
     }
 
+    UnrollGen getUnrollGen(LLVMSliceBlock *bb) {
+      return UnrollGen(uc, &dag, bb);
+    }
+
+    // a loop whose iterations are checked in closed form
+    void addSummarizedLoop(Loop *loop) {
+      loops.push_back(loop);
+      uc.addSummarized(loop->getHeader());
+    }
+
+    // whether taking the branch toward the block leaves such a loop, the
+    // trace then stands for any number of iterations, so the exit
+    // condition, which would pin it to the one taken, is left out
+    bool isSummarizedExit(BranchInst *branch, BasicBlock *to) {
+      for(Loop *loop : loops){
+        if(loop->contains(branch) && !loop->contains(to)){
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    // number of traces toward the block, without unrolling them
+    uint64_t estimatePaths(LLVMSliceBlock *bb) {
+      return uc.countUnrolled(&dag, bb);
+    }
+
+    // the blocks on all traces toward the block, in a topological order and 
+    // ending with the block, false if a loop is on the way
+    bool getRegion(LLVMSliceBlock *bb, blist &blks);
+
   protected:
     // mapping
-    map<Instruction *, SliceBlock *> insts;
+    DenseMap<Instruction *, SliceBlock *> insts;
 
     // basics
     SliceDomTree dt;
@@ -75,28 +107,99 @@ class SliceOracle {
     // DAG
     DAGraph dag;
     UnrollCache uc;
+
+    // loops checked in closed form
+    vector<Loop *> loops;
 };
 
 class FuncOracle {
   public:
     FuncOracle(Function &f, 
-        const DataLayout &dl, TargetLibraryInfo &tli) :
-      ac(f),
-      dt(f),
-      li(dt),
-      caa(dl, tli, ac, dt, li)
+        const DataLayout &d, TargetLibraryInfo &t) :
+      func(f), dl(d), tli(t),
+      ac(nullptr), dt(nullptr), li(nullptr), se(nullptr), caa(nullptr)
     {}
 
-    ~FuncOracle() {}
+    ~FuncOracle() {
+      delete caa;
+
+      // scalar evolution and the assumption cache it filled unlink their
+      // value handles from the shared context
+      if(se != nullptr){
+        lock_guard<mutex> guard(getSCEVLock());
+        delete se;
+        delete ac;
+      } else {
+        delete ac;
+      }
+
+      delete li;
+      delete dt;
+    }
+
+    // reachability, the blocks that may reach cur (including itself), 
+    // computed for all blocks of the function on the first request
+    BlockSet getReachBlocks(BasicBlock *cur);
+
+    // analyses, built on first request as they are expensive, especially
+    // the alias analysis, and most functions never need them
+    DominatorTree &getDomTree() {
+      prepareLoops();
+      return *dt;
+    }
+
+    LoopInfo &getLoopInfo() {
+      prepareLoops();
+      return *li;
+    }
+
+    // scalar evolution interns its expressions and value handles in the
+    // LLVMContext shared by all workers, so it is only built, queried and
+    // destroyed while holding this lock
+    static mutex &getSCEVLock();
+
+    ScalarEvolution &getScalarEvolution() {
+      prepareLoops();
+      if(se == nullptr){
+        se = new ScalarEvolution(func, tli, *ac, *dt, *li);
+      }
+      return *se;
+    }
+
+    CombinedAA &getAliasAnalysis() {
+      prepare();
+      return *caa;
+    }
+
+    // backward dependencies, shared by all slices of the function
+    DepIndex &getDepIndex() {
+      return deps;
+    }
 
-    // reachability
-    void getReachBlocks(BasicBlock *cur, set<BasicBlock *> &blks);
+  protected:
+    void prepare();
+    void prepareLoops();
+    void prepareReach();
 
   protected:
-    AssumptionCache ac;
-    DominatorTree dt;
-    LoopInfo li;
-    CombinedAA caa;
+    // context
+    Function &func;
+    const DataLayout &dl;
+    TargetLibraryInfo &tli;
+
+    // analyses
+    AssumptionCache *ac;
+    DominatorTree *dt;
+    LoopInfo *li;
+    ScalarEvolution *se;
+    CombinedAA *caa;
+
+    // block numbering and per-block backward reachability
+    vector<BasicBlock *> blocks;
+    DenseMap<BasicBlock *, unsigned> ids;
+    vector<BitVector> reach;
+
+    DepIndex deps;
 };
 
 class ModuleOracle {
@@ -104,7 +207,9 @@ class ModuleOracle {
     ModuleOracle(Module &m) : 
       dl(m.getDataLayout()),
       tli(TargetLibraryInfoImpl(Triple(Twine(m.getTargetTriple()))))
-    {}
+    {
+      prepareLayouts(m);
+    }
 
     ~ModuleOracle() {}
 
@@ -148,6 +253,11 @@ class ModuleOracle {
         (ty->isIntegerTy() && ty->getIntegerBitWidth() == getPointerWidth());
     }
 
+  protected:
+    // struct layouts are lazily cached in DataLayout, compute them upfront
+    // so that queries from concurrent function handlers are read-only
+    void prepareLayouts(Module &m);
+
   protected:
     // info provider
     const DataLayout &dl;
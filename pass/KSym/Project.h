@@ -8,19 +8,31 @@
 #include <string>
 #include <exception>
 
+#include <deque>
 #include <set>
 #include <map>
 #include <queue>
 #include <vector>
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+
 #include <llvm/Pass.h>
 
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FormatVariadic.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/PostOrderIterator.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/CodeGen/SlotIndexes.h>
 
@@ -33,6 +45,7 @@
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
+#include <llvm/IR/TypeFinder.h>
 
 #include <llvm/Analysis/CFG.h>
 
@@ -76,11 +89,13 @@ using json = nlohmann::json;
 // project globals
 extern Dumper DUMP;
 
+// per-thread globals, merged into the main thread after the workers join
 #ifdef KSYM_DEBUG
-extern Logger SLOG;
+extern thread_local Logger SLOG;
 #endif
 
-extern set<Function *> EXCEPT;
+extern thread_local set<Function *> EXCEPT;
+extern thread_local set<Function *> TIMEOUT;
 
 // project includes
 #include "Slice.h"
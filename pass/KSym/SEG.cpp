@@ -9,9 +9,11 @@
 void SEOpv::setHost(SENode *h) {
   host = h;
 
+  // a value used more than once is linked once
   for(SENode *v : vals){
-    v->addUsr(h);
-    h->addDep(v);
+    if(h->addDep(v)){
+      v->addUsr(h);
+    }
   }
 }
 
@@ -871,6 +873,28 @@ SymVal *SEOpvPhi::derive(SymExec &sym,
   FINI_EXPR;
 }
 
+void SEOpvPhiMerge::symbolize(SymExec &sym, SymVar *var) {
+  INIT_EXPR;
+
+  assert(isa<PHINode>(inst) && !vals.empty());
+
+  // ite(e1, v1, ite(e2, v2, ... vn)), the last value stands for the case
+  // where the block is not reached at all
+  SEGraph *graph = host->getGraph();
+
+  int last = vals.size() - 1;
+  expr.expr = vals.at(last)->getSymbol(sym)->getSingleVal()->getExpr().expr;
+
+  for(int k = last - 1; k >= 0; k--){
+    expr.expr = Z3_mk_ite(sym.getContext(),
+        graph->getEdgeGuard(sym, froms.at(k), block),
+        vals.at(k)->getSymbol(sym)->getSingleVal()->getExpr().expr,
+        expr.expr);
+  }
+
+  var->add(new SymVal(expr, cond));
+}
+
 SymVal *SEOpvSelect::derive(SymExec &sym,
     SymVal *cval, SymVal *tval, SymVal *fval) {
 
@@ -900,7 +924,7 @@ SymVal *SEOpvBranch::derive(SymExec &sym,
     // false value taken
     sym.addAssert(sym.castMachIntToBoolInversed(cval->getExpr().expr));
   } else {
-    // no branch is taken, do nothing
+    // no branch is taken, or both are in a merged graph, do nothing
   }
 
   expr.expr = sym.createSpecialNone();
@@ -958,14 +982,48 @@ bool SEGraph::locateValue(int cur, Value *val, int &seq) {
 
   // instructions can only be located from instructions
   assert(cur >= 0);
+  assert(cur < int(indexed.size()));
 
-  for(seq = cur; seq >= 0; seq--){
-    if(trace.at(seq) == val){
-      return true;
-    }
+  auto i = locs.find(val);
+  if(i == locs.end()){
+    return false;
   }
 
-  return false;
+  // the last position not after cur
+  vector<int> &pos = i->second;
+  auto pi = std::upper_bound(pos.begin(), pos.end(), cur);
+  if(pi == pos.begin()){
+    return false;
+  }
+
+  seq = *(--pi);
+  return true;
+}
+
+void SEGraph::indexTrace(int from) {
+  unindexTrace(from);
+
+  int len = trace.size();
+  for(int seq = indexed.size(); seq < len; seq++){
+    Instruction *inst = trace.at(seq);
+    locs[inst].push_back(seq);
+    indexed.push_back(inst);
+  }
+}
+
+void SEGraph::unindexTrace(int from) {
+  // positions are dropped from the back, so they are the last of their value
+  while(int(indexed.size()) > from){
+    auto i = locs.find(indexed.back());
+    assert(i != locs.end() && i->second.back() == int(indexed.size()) - 1);
+
+    i->second.pop_back();
+    if(i->second.empty()){
+      locs.erase(i);
+    }
+
+    indexed.pop_back();
+  }
 }
 
 // node getter
@@ -975,7 +1033,7 @@ SENode *SEGraph::getNode(int seq, Value *val) {
   // first check whether the node exists
   auto i = nodes.find(k);
   if(i != nodes.end()){
-    return i->second;
+    return byid[i->second];
   }
 
   // then make sure the value exists at given location
@@ -986,9 +1044,7 @@ SENode *SEGraph::getNode(int seq, Value *val) {
   }
 
   // finally build the node
-  SENode *res = buildNode(seq, val);
-  nodes.insert(make_pair(k, res));
-  return res;
+  return buildNode(seq, val);
 }
 
 SENode *SEGraph::getNodeOrBuild(int cur, Value *val) {
@@ -1006,7 +1062,7 @@ SENode *SEGraph::getNodeOrNull(int seq, Value *val) {
   if(i == nodes.end()){
     return nullptr;
   } else {
-    return i->second;
+    return byid[i->second];
   }
 }
 
@@ -1027,9 +1083,14 @@ SENode *SEGraph::getNodeProbe(Value *val) {
     return getNodeOrNull(-1, val);
   }
 
+  auto i = locs.find(val);
+  if(i == locs.end()){
+    return nullptr;
+  }
+
   SENode *node;
-  for(int i = trace.size() - 1; i >= 0; i--){
-    node = getNodeOrNull(i, val);
+  for(auto pi = i->second.rbegin(); pi != i->second.rend(); ++pi){
+    node = getNodeOrNull(*pi, val);
     if(node != nullptr){
       return node;
     }
@@ -1038,6 +1099,105 @@ SENode *SEGraph::getNodeProbe(Value *val) {
   return nullptr;
 }
 
+// call table
+template<typename T>
+static SEOpv *makeOpv0(int seq, CallInst *op, SENode **args) {
+  return new T(seq, op);
+}
+
+template<typename T>
+static SEOpv *makeOpv1(int seq, CallInst *op, SENode **args) {
+  return new T(seq, op, args[0]);
+}
+
+template<typename T>
+static SEOpv *makeOpv2(int seq, CallInst *op, SENode **args) {
+  return new T(seq, op, args[0], args[1]);
+}
+
+template<typename T>
+static SEOpv *makeOpv3(int seq, CallInst *op, SENode **args) {
+  return new T(seq, op, args[0], args[1], args[2]);
+}
+
+static const CallSpec CALLS[] = {
+#define LIBCALL_SPEC
+#include "Libcall.def"
+#undef LIBCALL_SPEC
+
+#define ASMCALL_SPEC
+#include "Asmcall.def"
+#undef ASMCALL_SPEC
+};
+
+static StringMap<const CallSpec *> *createCallNames() {
+  StringMap<const CallSpec *> *names = new StringMap<const CallSpec *>();
+  for(const CallSpec &spec : CALLS){
+    assert(names->find(spec.name) == names->end());
+    names->insert(make_pair(spec.name, &spec));
+  }
+
+  return names;
+}
+
+namespace CallTable {
+
+// bumped per module, a worker drops its matched callees when it lags
+static atomic<unsigned> epoch(0);
+
+void reset() {
+  epoch++;
+}
+
+const CallSpec *lookup(CallInst *call) {
+  // filled on first use and read-only after, shared by all workers
+  static StringMap<const CallSpec *> *names = createCallNames();
+
+  // callees already matched by the worker
+  static thread_local DenseMap<Value *, const CallSpec *> resolved;
+  static thread_local unsigned filled = 0;
+
+  if(filled != epoch){
+    resolved.clear();
+    filled = epoch;
+  }
+
+  // TODO indirect call
+  if(!call->isInlineAsm() && call->getCalledFunction() == nullptr){
+    return nullptr;
+  }
+
+  Value *callee = call->getCalledValue();
+  auto i = resolved.find(callee);
+  if(i != resolved.end()){
+    return i->second;
+  }
+
+  std::string fn;
+  if(call->isInlineAsm()){
+    InlineAsm *bin = dyn_cast<InlineAsm>(callee);
+    assert(bin != nullptr);
+    fn = bin->getAsmString();
+  } else {
+    Function *tar = call->getCalledFunction();
+    fn = tar->getName().str();
+    if(tar->isIntrinsic()){
+      Helper::convertDotInName(fn);
+    }
+  }
+
+  const CallSpec *spec = nullptr;
+
+  auto k = names->find(fn);
+  if(k != names->end() && k->second->inasm == call->isInlineAsm()){
+    spec = k->second;
+  }
+
+  resolved.insert(make_pair(callee, spec));
+  return spec;
+}
+
+}
 
 // node builder
 #define INIT_TYPE(val_type)                                         \
@@ -1048,7 +1208,8 @@ SENode *SEGraph::getNodeProbe(Value *val) {
   }
 
 #define INIT_NODE(se_type)                                          \
-  SENode##se_type *node = new SENode##se_type(seq, op, this);       \
+  SENode##se_type *node =                                           \
+    new(getArena()) SENode##se_type(seq, op, this);                 \
   addNode(node);
 
 #define FINI_NODE                                                   \
@@ -1063,7 +1224,8 @@ SENode *SEGraph::getNodeProbe(Value *val) {
   FINI_TYPE
 
 #define IGNORE_NODE                                                 \
-  SENodeUnknown *node = new SENodeUnknown(seq, op, this);           \
+  SENodeUnknown *node =                                             \
+    new(getArena()) SENodeUnknown(seq, op, this);                   \
   addNode(node);                                                    \
   return node;
 
@@ -1072,27 +1234,51 @@ SENode *SEGraph::getNodeProbe(Value *val) {
   IGNORE_NODE                                                       \
   FINI_TYPE
 
+#define CASE_VALUE(val_kind)                                        \
+  case Value::val_kind##Val:
+
+#define CASE_INST(opcode)                                           \
+  case Value::InstructionVal + Instruction::opcode:
+
 #define UNHANDLED(msg)                                              \
   DUMP.typedValue(val);                                             \
   llvm_unreachable("Unhandled: " msg);                              \
   return nullptr;
 
 SENode *SEGraph::buildNode(int seq, Value *val) {
+  // jump to the builder of the value kind right away, each builder still 
+  // checks its type and the unexpected ones end up unhandled
+  switch(val->getValueID()){
+
   // variables
+  CASE_VALUE(Argument)
   INIT_TYPE_NODE(Argument, Param) {} FINI_TYPE_NODE;
+  break;
 
+  CASE_VALUE(GlobalVariable)
   INIT_TYPE_NODE(GlobalVariable, Global) {} FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Alloca)
   INIT_TYPE_NODE(AllocaInst, Local) {} FINI_TYPE_NODE;
+  break;
 
+  CASE_VALUE(UndefValue)
   IGNORE_TYPE(UndefValue);
+  break;
 
   // constants
+  CASE_VALUE(ConstantInt)
   INIT_TYPE_NODE(ConstantInt, CInt) {} FINI_TYPE_NODE;
+  break;
 
+  CASE_VALUE(ConstantPointerNull)
   INIT_TYPE_NODE(ConstantPointerNull, CNull) {} FINI_TYPE_NODE;
+  break;
 
   // instructions
+#define HANDLE_CAST_INST(num, opcode, Class) CASE_INST(opcode)
+#include <llvm/IR/Instruction.def>
   INIT_TYPE_NODE(CastInst, Cast) {
     SENode *orig = getNodeOrBuild(seq, op->getOperand(0));
 
@@ -1122,7 +1308,10 @@ SENode *SEGraph::buildNode(int seq, Value *val) {
     }
 
   } FINI_TYPE_NODE;
+  break;
 
+#define HANDLE_BINARY_INST(num, opcode, Class) CASE_INST(opcode)
+#include <llvm/IR/Instruction.def>
   INIT_TYPE_NODE(BinaryOperator, Calc) {
     SENode *lhs = getNodeOrBuild(seq, op->getOperand(0));
     SENode *rhs = getNodeOrBuild(seq, op->getOperand(1));
@@ -1173,7 +1362,10 @@ SENode *SEGraph::buildNode(int seq, Value *val) {
         break;
     }
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(ICmp)
+  CASE_INST(FCmp)
   INIT_TYPE_NODE(CmpInst, Cmp) {
     assert(op->getOpcode() == Instruction::ICmp);
 
@@ -1194,7 +1386,9 @@ SENode *SEGraph::buildNode(int seq, Value *val) {
         break;
     }
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(GetElementPtr)
   INIT_TYPE_NODE(GetElementPtrInst, GEP) {
     vector<Value *> vars;
     SEGUtil::decompose(op, vars);
@@ -1225,205 +1419,377 @@ SENode *SEGraph::buildNode(int seq, Value *val) {
         break;
     }
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(PHI)
   INIT_TYPE_NODE(PHINode, Phi) {
-    Value *opv = SEGUtil::backtrace(seq, op, trace, so);
-    SENode *tran = getNodeOrBuild(seq, opv);
-    node->addOpv(new SEOpvPhi(seq, op, tran));
+    if(merged){
+      SliceBlock *host = so.getSliceHost(op);
+      assert(host != nullptr);
+
+      SEOpvPhiMerge *opv = new SEOpvPhiMerge(seq, op, host);
+
+      SliceBlock::linkIter pi = host->predBegin(), pe = host->predEnd();
+      for(; pi != pe; ++pi){
+        if(region.find(*pi) == region.end()){
+          continue;
+        }
+
+        Value *val = SEGUtil::incoming(op, host, *pi);
+        opv->addEdge(*pi, getNodeOrBuild(seq, val));
+      }
+
+      node->addOpv(opv);
+    } else {
+      Value *opv = SEGUtil::backtrace(seq, op, trace, so);
+      SENode *tran = getNodeOrBuild(seq, opv);
+      node->addOpv(new SEOpvPhi(seq, op, tran));
+    }
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Select)
   INIT_TYPE_NODE(SelectInst, Select) {
     SENode *cval = getNodeOrBuild(seq, op->getCondition());
     SENode *tval = getNodeOrBuild(seq, op->getTrueValue());
     SENode *fval = getNodeOrBuild(seq, op->getFalseValue());
     node->addOpv(new SEOpvSelect(seq, op, cval, tval, fval));
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Br)
   INIT_TYPE_NODE(BranchInst, Branch) {
     SENode *cval = getNodeOrBuild(seq, op->getCondition());
     node->addOpv(new SEOpvBranch(seq, op, cval));
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Load)
   INIT_TYPE_NODE(LoadInst, Load) {
     SENode *ptr = getNodeOrBuild(seq, op->getPointerOperand());
     node->addOpv(new SEOpvLoad(seq, op, ptr));
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Store)
   INIT_TYPE_NODE(StoreInst, Store) {
     SENode *ptr = getNodeOrBuild(seq, op->getPointerOperand());
     SENode *vop = getNodeOrBuild(seq, op->getValueOperand());
     node->addOpv(new SEOpvStore(seq, op, ptr, vop));
   } FINI_TYPE_NODE;
+  break;
 
+  CASE_INST(Call)
   INIT_TYPE(CallInst) {
-    // inline asm
-    if(op->isInlineAsm()){
-      InlineAsm *bin = dyn_cast<InlineAsm>(op->getCalledValue());
-      assert(bin != nullptr);
-      std::string fn = bin->getAsmString();
-
-#define ASMCALL_NODE
-#include "Asmcall.def"
-#undef ASMCALL_NODE
-
-      // TODO other inline asm
+    // lib calls and inline asm, resolved once per callee
+    const CallSpec *spec = CallTable::lookup(op);
+    if(spec == nullptr){
+      // TODO indirect call and other calls
       IGNORE_NODE;
     }
 
-    // lib calls
-    Function *tar = op->getCalledFunction();
-    if(tar == nullptr){
-      // TODO indirect call
-      IGNORE_NODE;
+    if(spec->inasm){
+      INIT_NODE(Asm) {
+        buildCallOpv(seq, op, spec, node);
+      } FINI_NODE;
+    } else {
+      INIT_NODE(Call) {
+        buildCallOpv(seq, op, spec, node);
+      } FINI_NODE;
     }
-
-    std::string fn = tar->getName().str();
-    if(tar->isIntrinsic()){
-      Helper::convertDotInName(fn);
-    }
-
-#define LIBCALL_NODE
-#include "Libcall.def"
-#undef LIBCALL_NODE
-
-    // TODO other lib calls
-    IGNORE_NODE;
   } FINI_TYPE;
+  break;
 
+  CASE_INST(ExtractValue)
   INIT_TYPE_NODE(ExtractValueInst, ExtVal) {
     SENode *ptr = getNodeOrBuild(seq, op->getAggregateOperand());
     node->addOpv(new SEOpvExtVal(seq, op, ptr));
   } FINI_TYPE_NODE;
+  break;
 
   // TODO, handle ExtractElementInst and InsertElemInst
+  CASE_INST(ExtractElement)
   IGNORE_TYPE(ExtractElementInst);
+  break;
+
+  CASE_INST(InsertElement)
   IGNORE_TYPE(InsertElementInst);
+  break;
+
+  CASE_VALUE(Function)
   IGNORE_TYPE(Function);
+  break;
+
+  default:
+  break;
+  }
 
   // should have enumerated all cases
   UNHANDLED("Unknown value type for node building");
 }
 
+void SEGraph::buildCallOpv(int seq, CallInst *op, const CallSpec *spec,
+    SENodeInst *node) {
+
+  SENode *args[3];
+  for(unsigned i = 0; i < spec->num; i++){
+    args[i] = getNodeOrBuild(seq, op->getArgOperand(spec->pos[i]));
+  }
+
+  node->addOpv(spec->make(seq, op, args));
+}
+
 // SEGraph construction
-static inline void collectDeps(SENode *node, set<SENode *> &deps) {
-  if(deps.find(node) != deps.end()){
-    return;
+SENode *SEGraph::followBranch(int seq, BranchInst *branch) {
+  if(!branch->isConditional()){
+    return nullptr;
   }
 
-  deps.insert(node);
+  // both directions are kept in a merged graph, the guards tell them apart
+  int dir = -1;
 
-  SENode::linkIter di = node->depBegin(), de = node->depEnd();
-  for(; di != de; ++di){
-    collectDeps(*di, deps);
+  if(!merged){
+    SliceBlock *host = so.getSliceHost(branch);
+    assert(host != nullptr);
+
+    SliceBlock *next = so.getSliceHost(trace.at(seq + 1));
+    assert(next != nullptr);
+
+    BasicBlock *tval = branch->getSuccessor(0);
+    BasicBlock *fval = branch->getSuccessor(1);
+
+    if(host->inSTab(next, tval) && host->inSTab(next, fval)){
+      // this branch is irrelevant
+      return nullptr;
+    }
+
+    dir = host->inSTab(next, tval) ? 0 : 1;
+
+    // leaving a summarized loop, the condition is built for the trip count
+    // to be symbolized from what it depends on, but is not asserted
+    if(so.isSummarizedExit(branch, dir == 0 ? tval : fval)){
+      dir = -1;
+    }
+  }
+
+  SENode *brch = getNodeOrBuild(seq, branch);
+  conds.insert(make_pair(brch, dir));
+  return brch;
+}
+
+void SEGraph::followInst(int seq, Instruction *inst) {
+  // steped on a condition or a connection
+  if(isa<TerminatorInst>(inst)){
+    BranchInst *branch = dyn_cast<BranchInst>(inst);
+    assert(branch != nullptr);
+
+    followBranch(seq, branch);
+  }
+
+  // normal instrucitons
+  else {
+    getNodeOrBuild(seq, inst);
   }
 }
 
-void SEGraph::followTrace() {
-  int seq = 0;
+void SEGraph::buildGraph() {
+  // positions of the instructions that would get a node, by their operands
+  DenseMap<Value *, vector<int>> uses;
+
+  int len = trace.size();
+  for(int seq = 0; seq < len; seq++){
+    Instruction *inst = trace.at(seq);
 
-  for(Instruction *inst : trace){
-    // steped on a condition or a connection
     if(isa<TerminatorInst>(inst)){
       BranchInst *branch = dyn_cast<BranchInst>(inst);
       assert(branch != nullptr);
-      
-      if(branch->isConditional()){
-        SENode *brch = getNodeOrBuild(seq, branch);
 
-        SliceBlock *host = so.getSliceHost(branch);
-        assert(host != nullptr);
+      if(!branch->isConditional()){
+        continue;
+      }
 
-        SliceBlock *next = so.getSliceHost(trace.at(seq + 1));
-        assert(next != nullptr);
+      // conditions are built here along with what they depend on
+      followBranch(seq, branch);
+    }
 
-        BasicBlock *tval = branch->getSuccessor(0);
-        BasicBlock *fval = branch->getSuccessor(1);
+    for(Value *op : inst->operand_values()){
+      uses[op].push_back(seq);
+    }
+  }
 
-        if(host->inSTab(next, tval) && host->inSTab(next, fval)){
-          // this branch is irrelevant
-        }
+  getNodeOrBuild(len - 1, trace.back());
+
+  // the nodes built so far are all kept, what is left is to pull in the
+  // instructions that depend on any kept node, together with their deps
+  // indexed by node id, grown as users get built
+  vector<bool> keep(count, false);
+  vector<SENode *> work;
+  for(SENode *node : byid){
+    if(node != nullptr){
+      keep[node->getId()] = true;
+      work.push_back(node);
+    }
+  }
 
-        else if(host->inSTab(next, tval)){
-          conds.insert(make_pair(brch, 0));
+  while(!work.empty()){
+    SENode *node = work.back();
+    work.pop_back();
+
+    // users built before but not linked to the kept nodes back then
+    vector<SENode *> adds(node->usrBegin(), node->usrEnd());
+
+    auto u = uses.find(node->getVal());
+    if(u != uses.end()){
+      vector<int> &pos = u->second;
+      auto li = std::upper_bound(pos.begin(), pos.end(), node->getSeq());
+      for(; li != pos.end(); ++li){
+        Instruction *inst = trace.at(*li);
+        if(getNodeOrNull(*li, inst) != nullptr){
+          continue;
         }
 
-        else {
-          conds.insert(make_pair(brch, 1));
+        // the operand might be located elsewhere or not be linked at all,
+        // so the user is left out until it hangs on a kept node
+        SENode *user = getNodeOrBuild(*li, inst);
+        keep.resize(count, false);
+
+        SENode::linkIter di = user->depBegin(), de = user->depEnd();
+        for(; di != de; ++di){
+          if(keep[(*di)->getId()]){
+            adds.push_back(user);
+            break;
+          }
         }
       }
     }
 
-    // normal instrucitons
-    else {
-      getNodeOrBuild(seq, inst);
+    // keep the users with all their deps
+    while(!adds.empty()){
+      SENode *add = adds.back();
+      adds.pop_back();
+
+      if(keep[add->getId()]){
+        continue;
+      }
+
+      keep[add->getId()] = true;
+      work.push_back(add);
+      adds.insert(adds.end(), add->depBegin(), add->depEnd());
+    }
+  }
+
+  // delete the nodes left out
+  vector<SENode *> dels;
+  for(SENode *node : byid){
+    if(node != nullptr && !keep[node->getId()]){
+      dels.push_back(node);
     }
+  }
 
-    // go to the next inst in list
-    seq++;
+  for(SENode *node : dels){
+    dropNode(node);
   }
 }
 
-void SEGraph::trimGraph() {
-  set<SENode *> deps;
-
-  // collect init set
-  SENode *term = getNode(trace.size() - 1, trace.back());
-  assert(term != nullptr);
-  collectDeps(term, deps);
+void SEGraph::dropNode(SENode *node) {
+  SENode::linkIter di = node->depBegin(), de = node->depEnd();
+  for(; di != de; ++di){
+    (*di)->delUsr(node);
+  }
 
-  for(auto &i : conds){
-    SENode *cond = i.first;
-    collectDeps(cond, deps);
+  SENode::linkIter ui = node->usrBegin(), ue = node->usrEnd();
+  for(; ui != ue; ++ui){
+    (*ui)->delDep(node);
   }
 
-  // expand the set
-  bool changed = true;
-  while(changed) {
-    changed = false;
+  conds.erase(node);
+  nodes.erase(make_pair(node->getSeq(), node->getVal()));
+  byid[node->getId()] = nullptr;
+  node->~SENode();
+}
 
-    for(auto &i : nodes){
-      SENode *node = i.second;
-      if(deps.find(node) != deps.end()){
-        continue;
-      }
+// incremental construction
+int SEGraph::extend(int from) {
+  indexTrace(from);
 
-      SENode::linkIter di = node->depBegin(), de = node->depEnd();
-      for(; di != de; ++di){
-        if(deps.find(*di) != deps.end()){
-          collectDeps(node, deps);
-          changed = true;
-          break;
-        }
-      }
+  grown.push_back(new BumpPtrAllocator());
+  marks.push_back(count);
 
-      if(changed){
-        break;
-      }
+  int len = trace.size();
+
+  int seq;
+  for(seq = from; seq < len; seq++){
+    Instruction *inst = trace.at(seq);
+
+    // the direction of a trailing branch is unknown until the trace grows
+    if(isa<TerminatorInst>(inst) && seq + 1 == len){
+      break;
     }
+
+    followInst(seq, inst);
   }
 
-  // delete non-related nodes
-  set<SENode *> dels;
-  for(auto &i : nodes){
-    SENode *node = i.second;
-    if(deps.find(node) == deps.end()){
-      dels.insert(node);
+  return seq;
+}
+
+void SEGraph::retract(int from) {
+  assert(!grown.empty());
+
+  // the nodes built earlier are complete and never depend on later ones, 
+  // so the ids given out since the extend can be reused
+  unsigned mark = marks.back();
+  for(unsigned i = byid.size(); i > mark; i--){
+    if(byid[i - 1] != nullptr){
+      dropNode(byid[i - 1]);
     }
   }
 
-  for(SENode *node : dels){
-    SENode::linkIter di = node->depBegin(), de = node->depEnd();
-    for(; di != de; ++di){
-      (*di)->delUsr(node);
+  byid.resize(mark);
+  count = mark;
+
+  delete grown.back();
+  grown.pop_back();
+  marks.pop_back();
+
+  unindexTrace(from);
+}
+
+void SEGraph::getShape(Shape &shape) {
+  // nodes on the trace are named by their order among the nodes left, so 
+  // that the shape is free of the positions of the trimmed instructions
+  map<SENode *, int> index;
+
+  int len = trace.size();
+  for(int c = 0; c < len; c++){
+    Instruction *i = trace.at(c);
+
+    SENode *node = getNodeOrNull(c, i);
+    if(node == nullptr){
+      continue;
     }
 
-    SENode::linkIter ui = node->usrBegin(), ue = node->usrEnd();
-    for(; ui != ue; ++ui){
-      (*ui)->delDep(node);
+    int k = index.size();
+    index.insert(make_pair(node, k));
+
+    shape.push_back(make_pair(i, getCond(node)));
+    shape.push_back(make_pair(nullptr, int(node->numDeps())));
+
+    // deps are in the order they were linked, so name them before sorting
+    Shape deps;
+
+    SENode::linkIter di = node->depBegin(), de = node->depEnd();
+    for(; di != de; ++di){
+      auto d = index.find(*di);
+      if(d == index.end()){
+        assert((*di)->getSeq() < 0);
+        deps.push_back(make_pair((*di)->getVal(), -1));
+      } else {
+        deps.push_back(make_pair((*di)->getVal(), d->second));
+      }
     }
 
-    nodes.erase(make_pair(node->getSeq(), node->getVal()));
-    delete node;
+    std::sort(deps.begin(), deps.end());
+    shape.insert(shape.end(), deps.begin(), deps.end());
   }
 }
 
@@ -57,6 +57,7 @@ enum SEType {
   SE_GEPIdx2,
   SE_GEP,
 
+  SE_PhiMerge,
   SE_Phi,
   SE_Select,
   SE_Branch,
@@ -296,19 +297,25 @@ class SENode {
     }
 
     void addUsr(SENode *n) {
-      usrs.insert(n);
+      usrs.push_back(n);
     }
 
     void delUsr(SENode *n) {
-      usrs.erase(n);
+      usrs.erase(std::find(usrs.begin(), usrs.end(), n));
     }
 
-    void addDep(SENode *n) {
-      deps.insert(n);
+    // false if n is a dep already
+    bool addDep(SENode *n) {
+      if(std::find(deps.begin(), deps.end(), n) != deps.end()){
+        return false;
+      }
+
+      deps.push_back(n);
+      return true;
     }
 
     void delDep(SENode *n) {
-      deps.erase(n);
+      deps.erase(std::find(deps.begin(), deps.end(), n));
     }
 
     unsigned numUsrs() {
@@ -319,7 +326,9 @@ class SENode {
       return deps.size();
     }
 
-    typedef typename set<SENode *>::iterator linkIter;
+    // links are few for most nodes and kept in insertion order
+    typedef SmallVector<SENode *, 4> linkList;
+    typedef typename linkList::iterator linkIter;
 
     linkIter usrBegin() {
       return usrs.begin();
@@ -351,8 +360,8 @@ class SENode {
 
     // links 
     SEGraph *graph;
-    set<SENode *> usrs;
-    set<SENode *> deps;
+    linkList usrs;
+    linkList deps;
 };
 
 class SENodeLeaf : public SENode {
@@ -562,6 +571,32 @@ OPV_2(GEPIdx1, Ptr, Idx0);
 OPV_3(GEPIdx2, Ptr, Idx0, Idx1);
 INST_NODE(GEP, GetElementPtrInst);
 
+// a phi taking all its incoming values at once, each under the guard of 
+// its edge, in a merged graph
+class SEOpvPhiMerge : public SEOpv {
+  public:
+    SEOpvPhiMerge(int s, Instruction *i, SliceBlock *b)
+      : SEOpv(SE_PhiMerge, 0, s, i), block(b) {}
+
+    ~SEOpvPhiMerge() {}
+
+    static bool classof(const SEOpv *op) {
+      return op->getType() == SE_PhiMerge;
+    }
+
+    // must be done before the opv is added to its host
+    void addEdge(SliceBlock *from, SENode *tran) {
+      froms.push_back(from);
+      addVal(tran);
+    }
+
+    void symbolize(SymExec &sym, SymVar *var) override;
+
+  protected:
+    SliceBlock *block;
+    vector<SliceBlock *> froms;
+};
+
 OPV_1(Phi, Tran);
 INST_NODE(Phi, PHINode);
 
@@ -590,19 +625,68 @@ INST_NODE(Asm, CallInst);
 OPV_1(ExtVal, Ptr);
 INST_NODE(ExtVal, ExtractValueInst);
 
+// a modeled libcall or asmcall, named by the callee or the asm string, with 
+// the positions of the arguments it depends on and the maker of its opv
+struct CallSpec {
+  const char *name;
+  bool inasm;
+  unsigned num;
+  unsigned pos[3];
+  SEOpv *(*make)(int seq, CallInst *op, SENode **args);
+};
+
+namespace CallTable {
+
+// the spec of the callee, nullptr if not modeled
+const CallSpec *lookup(CallInst *call);
+
+// forget the callees matched so far, before a new module is analyzed
+void reset();
+
+}
+
 // the SEG graph
 class SEGraph {
   public:
     SEGraph(SliceOracle &s, iseq &t) 
-      : so(s), trace(t), count(0) {
+      : so(s), trace(t), count(0), merged(false) {
 
-      followTrace();
-      trimGraph();
+      indexTrace(0);
+      buildGraph();
     } 
 
+    // an empty, untrimmed graph that grows and shrinks along with the trace
+    // through extend and retract
+    SEGraph(SliceOracle &s, iseq &t, bool growing) 
+      : so(s), trace(t), count(0), merged(false) {
+
+      assert(growing);
+    }
+
+    // a graph covering all traces through an acyclic region at once, the 
+    // trace lists the blocks of the region in a topological order, branches
+    // are not followed but turned into guards, under which the paths merge
+    SEGraph(SliceOracle &s, iseq &t, blist &blks) 
+      : so(s), trace(t), count(0), merged(true) {
+
+      for(LLVMSliceBlock *b : blks){
+        region.insert(b->getSliceBlock());
+      }
+
+      indexTrace(0);
+      buildGraph();
+    }
+
+    // the memory of the nodes goes away with the arenas
     ~SEGraph() {
-      for(auto const &i : nodes){
-        delete i.second;
+      for(SENode *node : byid){
+        if(node != nullptr){
+          node->~SENode();
+        }
+      }
+
+      for(BumpPtrAllocator *a : grown){
+        delete a;
       }
     }
 
@@ -611,7 +695,13 @@ class SEGraph {
       assert(nodes.find(key) == nodes.end());
 
       node->setId(count++);
-      nodes.insert(make_pair(key, node));
+      nodes.insert(make_pair(key, node->getId()));
+      byid.push_back(node);
+    }
+
+    // the number of ids given out so far, including those of dropped nodes
+    unsigned numIds() {
+      return count;
     }
 
     // for get node, seq must match the location of val
@@ -630,18 +720,20 @@ class SEGraph {
     // get the node with the highest in location
     SENode *getNodeProbe(Value *val);
 
-    // node iterator
-    typedef typename map<pair<int, Value *>, SENode *>::iterator iterator;
+    void filterTrace(iseq &filt);
 
-    iterator begin() {
-      return nodes.begin();
-    }
+    // the nodes left on the trace with their branch directions and their 
+    // links, traces of the same shape symbolize to the same formula
+    typedef vector<pair<Value *, int>> Shape;
+    void getShape(Shape &shape);
 
-    iterator end() {
-      return nodes.end();
-    }
+    // build nodes for the trace starting from position from, returns the 
+    // position to start from when the trace is extended next time
+    int extend(int from);
 
-    void filterTrace(iseq &filt);
+    // drop all nodes built by the matching extend, i.e., those located at or
+    // after position from and the non-instructions first used by them
+    void retract(int from);
 
     // get condition
     int getCond(SENode *node) {
@@ -653,22 +745,60 @@ class SEGraph {
       }
     }
 
+    bool isMerged() {
+      return merged;
+    }
+
+    // path guards of a merged graph, valid within the symbol engine they
+    // were first requested in
+    Z3_ast getGuard(SymExec &sym, SliceBlock *block);
+    Z3_ast getGuard(SymExec &sym, int seq);
+    Z3_ast getEdgeGuard(SymExec &sym, SliceBlock *from, SliceBlock *to);
+
     // symbols
     void symbolize(SymExec &sym);
 
+    // the expression of a loop-invariant SCEV over the symbols of the graph,
+    // nullptr if any of its parts is not available
+    Z3_ast symbolizeSCEV(SymExec &sym, const SCEV *expr);
+
+    // symbolize the nodes located in [from, to) only
+    void symbolize(SymExec &sym, int from, int to);
+
     // replay the instruction with the solved model and dump the trace 
-    void replay(SymExec &sym);
+    void replay(SymExec &sym, Z3_model model);
 
   protected:
     // locator
     bool locateValue(int cur, Value *val, int &seq);
 
+    // index the trace from position from on, positions before it must not
+    // have changed since they were indexed
+    void indexTrace(int from);
+    void unindexTrace(int from);
+
     // for build node method, cur might match the location of val
     SENode *buildNode(int seq, Value *val);
+    void buildCallOpv(int seq, CallInst *op, const CallSpec *spec,
+        SENodeInst *node);
+
+    // where the nodes being built go
+    BumpPtrAllocator &getArena() {
+      return grown.empty() ? arena : *grown.back();
+    }
+
+    // the condition of the branch leaving the block, nullptr if none
+    Z3_ast getExitCond(SymExec &sym, SliceBlock *block);
+
+    // for trace following, the node of a conditional branch that sets a
+    // condition, nullptr if the branch is irrelevant
+    SENode *followBranch(int seq, BranchInst *branch);
+    void followInst(int seq, Instruction *inst);
 
-    // for trace following and triming
-    void followTrace();
-    void trimGraph();
+    // build, backward from the fetch and the conditions, only the nodes
+    // that are linked to them
+    void buildGraph();
+    void dropNode(SENode *node);
 
   protected:
     // info provider
@@ -680,11 +810,30 @@ class SEGraph {
     // basics
     unsigned count;
 
-    // graph
-    map<pair<int, Value *>, SENode *> nodes;
+    // positions of the instructions on the trace, in increasing order, and
+    // the prefix of the trace they are taken from
+    DenseMap<Value *, vector<int>> locs;
+    iseq indexed;
+
+    // graph, nodes are allocated in the arena and indexed by their ids, 
+    // a dropped node leaves a null behind
+    BumpPtrAllocator arena;
+    vector<SENode *> byid;
+
+    // each extend allocates in an arena of its own, freed when retracted,
+    // along with the first id it gave out
+    vector<BumpPtrAllocator *> grown;
+    vector<unsigned> marks;
+    DenseMap<pair<int, Value *>, unsigned> nodes;
 
     // conditions
     map<SENode *, int> conds;
+
+    // merging
+    bool merged;
+    set<SliceBlock *> region;
+    map<SliceBlock *, Z3_ast> guards;
+    map<SliceBlock *, Z3_ast> exits;
 };
 
 // helpers
@@ -735,18 +884,8 @@ static void decompose(GetElementPtrInst *gep, vector<Value *> &vars) {
   assert(cty == gep->getResultElementType());
 }
 
-static Value *backtrace(int seq, PHINode *phi, iseq &trace, SliceOracle &so) {
-  SliceBlock *host = so.getSliceHost(phi);
-  assert(host != nullptr);
-
-  SliceBlock *prev = nullptr;
-  while(--seq >= 0){
-    prev = so.getSliceHost(trace.at(seq));
-    if(prev != host){
-      break;
-    }
-  }
-  assert(prev != nullptr && prev != host);
+// the value the phi takes when entered from prev
+static Value *incoming(PHINode *phi, SliceBlock *host, SliceBlock *prev) {
   assert(host->hasPred(prev) && host->inPTab(prev));
 
   Value *res = nullptr, *val;
@@ -767,6 +906,22 @@ static Value *backtrace(int seq, PHINode *phi, iseq &trace, SliceOracle &so) {
   return res;
 }
 
+static Value *backtrace(int seq, PHINode *phi, iseq &trace, SliceOracle &so) {
+  SliceBlock *host = so.getSliceHost(phi);
+  assert(host != nullptr);
+
+  SliceBlock *prev = nullptr;
+  while(--seq >= 0){
+    prev = so.getSliceHost(trace.at(seq));
+    if(prev != host){
+      break;
+    }
+  }
+  assert(prev != nullptr && prev != host);
+
+  return incoming(phi, host, prev);
+}
+
 } // end of SEGUtil namespace
 
 #endif /* SEG_H_ */
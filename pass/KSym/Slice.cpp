@@ -5,7 +5,7 @@
 // [disabled] #define KSYM_CONFIG_SLICE_COMPLETE
 
 // Pre-procesing
-static void collectInsts(set<BasicBlock *> &reach, set<Instruction *> &insts) {
+static void collectInsts(BlockSet &reach, set<Instruction *> &insts) {
   for(BasicBlock *bb : reach){
     for(Instruction &i : *bb){
       insts.insert(&i);
@@ -13,27 +13,43 @@ static void collectInsts(set<BasicBlock *> &reach, set<Instruction *> &insts) {
   }
 }
 
-// Backtracing
-bool Slice::btrace(Value *v) {
-  // test if we have backtraced this value
-  if(backs.find(v) != backs.end()){
-    return false;
+// Dependency index
+const DepIndex::DepEntry &DepIndex::getEntry(Value *v) {
+  auto i = index.find(v);
+  if(i != index.end()){
+    return i->second;
   }
 
+  DepEntry &entry = index[v];
+
   // check if v is a constant
   if(isa<ConstantData>(v) || isa<ConstantAggregate>(v)){
-    return false;
+    entry.kind = DEP_CONST;
   }
 
-  // mark that we have backtraced this value
-  backs.insert(v);
-
   // check if v is a root
-  if(isa<Argument>(v) || isa<GlobalObject>(v) || isa<AllocaInst>(v)){
-    return roots.insert(v).second;
+  else if(isa<Argument>(v) || isa<GlobalObject>(v) || isa<AllocaInst>(v)){
+    entry.kind = DEP_ROOT;
   }
 
-  // further decompose v
+  else {
+    entry.kind = DEP_INNER;
+
+    cur = &entry.deps;
+    decompose(v);
+    cur = nullptr;
+  }
+
+  return entry;
+}
+
+bool DepIndex::btrace(Value *v) {
+  cur->push_back(v);
+  return false;
+}
+
+void DepIndex::decompose(Value *v) {
+  // NOTE: res is only set by the btrace macros and is not used here
   bool res = false;
 
   if(ConstantExpr *i_cexp = dyn_cast<ConstantExpr>(v)){
@@ -58,61 +74,20 @@ bool Slice::btrace(Value *v) {
   else if(CallInst *i_call = dyn_cast<CallInst>(v)){
     // NOTE: CallInst is a black hole which might suck up everything,
     // so take caution not to trace unwanted conditions
-    if(i_call->isInlineAsm()){
-      InlineAsm *bin = dyn_cast<InlineAsm>(i_call->getCalledValue());
-      assert(bin != nullptr);
-      std::string fn = bin->getAsmString();
-
-      if(fn.empty()){
-        llvm_unreachable("Asm string cannot be empty");
-      }
-
-#define ASMCALL_BACK
-#include "Asmcall.def"
-#undef ASMCALL_BACK
+    const CallSpec *spec = CallTable::lookup(i_call);
 
-      else {
-        // default to ignore the rest
-        /*
-        errs() 
-          << i_call->getParent()->getParent()->getName() << "::" 
-          << fn << "\n";
-        */
-        // TODO handle the rest of the calls
+    if(spec != nullptr){
+      // modeled lib calls and inline asm, selectively trace the arguments
+      for(unsigned i = 0; i < spec->num; i++){
+        if(btrace(i_call->getArgOperand(spec->pos[i]))){
+          res = true;
+        }
       }
     }
 
     else {
-      Function *tar = i_call->getCalledFunction();
-      if(tar == nullptr){
-        // TODO handle indirect call
-      }
-
-      else {
-        // direct call, selectively trace the arguments
-        std::string fn = tar->getName().str();
-        if(tar->isIntrinsic()){
-          Helper::convertDotInName(fn);
-        }
-
-        if(fn.empty()){
-          llvm_unreachable("Function name cannot be empty");
-        }
-
-#define LIBCALL_BACK
-#include "Libcall.def"
-#undef LIBCALL_BACK
-
-        else {
-          // default to ignore the rest
-          /*
-          errs() 
-            << i_call->getParent()->getParent()->getName() << "::" 
-            << fn << "\n";
-          */
-          // TODO handle the rest of the calls
-        }
-      }
+      // default to ignore the rest
+      // TODO handle indirect calls and the rest of the calls
     }
   }
 
@@ -225,6 +200,48 @@ bool Slice::btrace(Value *v) {
     llvm_unreachable("Unknown value type to btrace");
   }
 
+  (void)res;
+}
+
+// Backtracing
+bool Slice::btrace(Value *v) {
+  bool res = false;
+
+  vector<Value *> work;
+  work.push_back(v);
+
+  while(!work.empty()){
+    Value *cur = work.back();
+    work.pop_back();
+
+    // test if we have backtraced this value
+    if(backs.find(cur) != backs.end()){
+      continue;
+    }
+
+    const DepIndex::DepEntry &entry = deps.getEntry(cur);
+    if(entry.kind == DepIndex::DEP_CONST){
+      continue;
+    }
+
+    // mark that we have backtraced this value
+    backs.insert(cur);
+
+    // the block needs to be re-applied
+    if(Instruction *inst = dyn_cast<Instruction>(cur)){
+      dirty.insert(inst->getParent());
+    }
+
+    if(entry.kind == DepIndex::DEP_ROOT){
+      if(roots.insert(cur).second){
+        res = true;
+      }
+      continue;
+    }
+
+    work.insert(work.end(), entry.deps.rbegin(), entry.deps.rend());
+  }
+
   return res;
 }
 
@@ -271,20 +288,25 @@ void Slice::follow(Value *v, set<Value *> &taints) {
 
 SliceBlock *Slice::apply(BasicBlock *bb) {
   // check if block is in the reachable set
-  if(reach.find(bb) == reach.end()){
+  if(!reach.contains(bb)){
     return nullptr;
   }
 
   // construct block
   SliceBlock *slice = new SliceBlock(bb);
+  fill(slice);
 
-  for(Instruction &inst : *bb){
+  return slice;
+}
+
+void Slice::fill(SliceBlock *slice) {
+  slice->clearInsts();
+
+  for(Instruction &inst : *slice->getBlock()){
     if(backs.find(&inst) != backs.end()){
       slice->addInst(&inst);
     }
   }
-
-  return slice;
 }
 
 SliceBlock *Slice::joint(BasicBlock *bb, list<BasicBlock *> &hists,
@@ -492,7 +514,7 @@ void Slice::expand(SliceBlock *item) {
       cur = que.front();
       que.pop();
 
-      if(reach.find(cur) == reach.end()){
+      if(!reach.contains(cur)){
         continue;
       }
 
@@ -527,7 +549,7 @@ void Slice::expand(SliceBlock *item) {
       cur = que.front();
       que.pop();
 
-      if(reach.find(cur) == reach.end()){
+      if(!reach.contains(cur)){
         continue;
       }
 
@@ -551,7 +573,8 @@ void Slice::expand(SliceBlock *item) {
 }
 
 // Slice construction
-Slice::Slice(set<BasicBlock *> &pred, Instruction *inst) : reach(pred) {
+Slice::Slice(BlockSet &pred, DepIndex &d, Instruction *inst) 
+  : reach(pred), deps(d) {
   // pre-process
   collectInsts(reach, scope);
   BasicBlock *head = &(inst->getParent()->getParent()->getEntryBlock());
@@ -580,24 +603,46 @@ Slice::Slice(set<BasicBlock *> &pred, Instruction *inst) : reach(pred) {
       }
     } while(!taints.empty());
 
-    // collect conditions
-    for(auto const &i : cache){
-      delete i.second;
-    }
+    // collect conditions, only the blocks with newly traced insts change,
+    // and the linking only depends on which blocks are empty, so when none
+    // of them turns non-empty, no new condition can be found
+    bool relink = false;
+
+    if(cache.empty()){
+      for(BasicBlock *bb : reach){
+        cache.insert(make_pair(bb, apply(bb)));
+      }
+
+      relink = true;
+    } else {
+      for(BasicBlock *bb : dirty){
+        auto i = cache.find(bb);
+        if(i == cache.end()){
+          continue;
+        }
+
+        SliceBlock *slice = i->second;
+        bool empty = slice->numInsts() == 0;
 
-    cache.clear();
-    suits.clear();
+        fill(slice);
 
-    for(BasicBlock *bb : reach){
-      cache.insert(make_pair(bb, apply(bb)));
+        if(empty && slice->numInsts() != 0){
+          relink = true;
+        }
+      }
     }
 
-    dedup.clear();
-    hists.clear();
-    entry = joint(head, hists, dedup, taints);
+    dirty.clear();
 
-    assert(hists.empty());
-    assert(entry != nullptr && suits.find(entry) != suits.end());
+    if(relink){
+      suits.clear();
+      dedup.clear();
+      hists.clear();
+      entry = joint(head, hists, dedup, taints);
+
+      assert(hists.empty());
+      assert(entry != nullptr && suits.find(entry) != suits.end());
+    }
   }
 
   basis = cache[inst->getParent()];
@@ -649,7 +694,7 @@ void Slice::verify() {
     for(; bpi != bpe; ++bpi){
       if(!item->inPTab(*bpi)){
         assert(
-            reach.find(*bpi) == reach.end() || 
+            !reach.contains(*bpi) || 
             suits.find(cache[*bpi]) == suits.end()
             );
       }
@@ -659,7 +704,7 @@ void Slice::verify() {
     for(; bsi != bse; ++bsi){
       if(!item->inSTab(*bsi)){
         assert(
-            reach.find(*bsi) == reach.end() ||
+            !reach.contains(*bsi) ||
             suits.find(cache[*bsi]) == suits.end()
             );
       }
@@ -6,7 +6,11 @@
 
 class SliceBlock {
   public:
-    SliceBlock(BasicBlock *bb) : block(bb) {}
+    SliceBlock(BasicBlock *bb) : block(bb) {
+      // the CFG edges of the block, densely numbered for the tables
+      bpreds.assign(pred_begin(bb), pred_end(bb));
+      bsuccs.assign(succ_begin(bb), succ_end(bb));
+    }
 
     ~SliceBlock() {}
 
@@ -18,7 +22,11 @@ class SliceBlock {
       insts.push_back(i);
     }
 
-    typedef typename list<Instruction *>::iterator instIter;
+    void clearInsts() {
+      insts.clear();
+    }
+
+    typedef typename vector<Instruction *>::iterator instIter;
 
     instIter instBegin() {
       return insts.begin();
@@ -75,79 +83,117 @@ class SliceBlock {
     }
 
     void addPTabEntry(SliceBlock *item, BasicBlock *bb) {
-      ptab[item].insert(bb);
+      ptab.add(item, indexOf(bpreds, bb), bpreds.size());
     }
 
     bool inPTab(SliceBlock *item, BasicBlock *bb) {
-      auto i = ptab.find(item);
-      assert(i != ptab.end());
-      return i->second.find(bb) != i->second.end();
+      int row = ptab.find(item);
+      assert(row >= 0);
+      return ptab.test(row, indexOf(bpreds, bb));
     }
 
     bool inPTab(SliceBlock *item) {
-      return ptab.find(item) != ptab.end();
+      return ptab.find(item) >= 0;
     }
 
     bool inPTab(BasicBlock *bb) {
-      for(auto const &i : ptab){
-        if(i.second.find(bb) != i.second.end()){
-          return true;
-        }
-      }
-
-      return false;
+      return ptab.any(indexOf(bpreds, bb));
     }
 
     void inPTab(BasicBlock *bb, set<SliceBlock *> &its) {
-      for(auto const &i : ptab){
-        if(i.second.find(bb) != i.second.end()){
-          its.insert(i.first);
-        }
-      }
+      ptab.collect(indexOf(bpreds, bb), its);
     }
 
     void addSTabEntry(SliceBlock *item, BasicBlock *bb) {
-      stab[item].insert(bb);
+      stab.add(item, indexOf(bsuccs, bb), bsuccs.size());
     }
 
     bool inSTab(SliceBlock *item, BasicBlock *bb) {
-      auto i = stab.find(item);
-      assert(i != stab.end());
-      return i->second.find(bb) != i->second.end();
+      int row = stab.find(item);
+      assert(row >= 0);
+      return stab.test(row, indexOf(bsuccs, bb));
     }
 
     bool inSTab(SliceBlock *item) {
-      return stab.find(item) != stab.end();
+      return stab.find(item) >= 0;
     }
 
     bool inSTab(BasicBlock *bb) {
-      for(auto const &i : stab){
-        if(i.second.find(bb) != i.second.end()){
-          return true;
-        }
+      return stab.any(indexOf(bsuccs, bb));
+    }
+
+    void inSTab(BasicBlock *bb, set<SliceBlock *> &its) {
+      stab.collect(indexOf(bsuccs, bb), its);
+    }
+
+    int instPosition(Instruction *inst) {
+      auto i = std::find(insts.begin(), insts.end(), inst);
+      if(i == insts.end()){
+        return -1;
       }
 
-      return false;
+      return i - insts.begin();
     }
 
-    void inSTab(BasicBlock *bb, set<SliceBlock *> &its) {
-      for(auto const &i : stab){
-        if(i.second.find(bb) != i.second.end()){
-          its.insert(i.first);
+  protected:
+    // mapping from linked items to the CFG edges leading to them, one bit
+    // row per item, one column per edge of the block
+    struct LinkTable {
+      vector<SliceBlock *> rows;
+      vector<BitVector> bits;
+
+      int find(SliceBlock *item) {
+        auto i = std::find(rows.begin(), rows.end(), item);
+        return i == rows.end() ? -1 : i - rows.begin();
+      }
+
+      void add(SliceBlock *item, int col, unsigned num) {
+        assert(col >= 0);
+
+        int row = find(item);
+        if(row < 0){
+          row = rows.size();
+          rows.push_back(item);
+          bits.push_back(BitVector(num));
         }
+
+        bits[row].set(col);
       }
-    }
 
-    int instPosition(Instruction *inst) {
-      int res = 0;
-      for(Instruction *i : insts){
-        if(i == inst){
-          return res;
+      bool test(int row, int col) {
+        return col >= 0 && bits[row].test(col);
+      }
+
+      bool any(int col) {
+        if(col < 0){
+          return false;
+        }
+
+        for(BitVector &b : bits){
+          if(b.test(col)){
+            return true;
+          }
+        }
+
+        return false;
+      }
+
+      void collect(int col, set<SliceBlock *> &its) {
+        if(col < 0){
+          return;
+        }
+
+        for(unsigned i = 0; i < rows.size(); i++){
+          if(bits[i].test(col)){
+            its.insert(rows[i]);
+          }
         }
-        i++;
       }
+    };
 
-      return -1;
+    static int indexOf(vector<BasicBlock *> &edges, BasicBlock *bb) {
+      auto i = std::find(edges.begin(), edges.end(), bb);
+      return i == edges.end() ? -1 : i - edges.begin();
     }
 
   protected:
@@ -155,20 +201,64 @@ class SliceBlock {
     BasicBlock *block;
 
     // insts 
-    list<Instruction *> insts;
+    vector<Instruction *> insts;
     
     // links
     vector<SliceBlock *> preds;
     vector<SliceBlock *> succs;
 
+    // CFG edges
+    vector<BasicBlock *> bpreds;
+    vector<BasicBlock *> bsuccs;
+
     // mapping
-    map<SliceBlock *, set<BasicBlock *>> ptab;
-    map<SliceBlock *, set<BasicBlock *>> stab;
+    LinkTable ptab;
+    LinkTable stab;
+};
+
+// the values each value directly depends on, as btrace follows them, 
+// shared by the slices of all fetches in a function, only the control
+// dependencies of phis (the branches of the incoming blocks) are indexed,
+// whether other branches matter depends on the blocks a slice keeps, so
+// it is still decided per slice in Slice::joint
+class DepIndex {
+  public:
+    enum DepKind {
+      // ignored
+      DEP_CONST,
+      // where backtracing stops
+      DEP_ROOT,
+      // to be further decomposed
+      DEP_INNER
+    };
+
+    struct DepEntry {
+      DepKind kind;
+      vector<Value *> deps;
+    };
+
+    DepIndex() : cur(nullptr) {}
+
+    ~DepIndex() {}
+
+    // computed on first request
+    const DepEntry &getEntry(Value *v);
+
+  protected:
+    void decompose(Value *v);
+
+    // record a dependency, named after Slice::btrace for Libcall.def and
+    // Asmcall.def
+    bool btrace(Value *v);
+
+  protected:
+    map<Value *, DepEntry> index;
+    vector<Value *> *cur;
 };
 
 class Slice {
   public:
-    Slice(set<BasicBlock *> &pred, Instruction *inst); 
+    Slice(BlockSet &pred, DepIndex &d, Instruction *inst); 
 
     ~Slice() {
       for(auto const &i : cache){
@@ -203,6 +293,7 @@ class Slice {
     void follow(Value *v, set<Value *> &taints);
 
     SliceBlock *apply(BasicBlock *bb);
+    void fill(SliceBlock *slice);
     SliceBlock *joint(BasicBlock *bb, list<BasicBlock *> &hists,
         map<BasicBlock *, SliceBlock *> &dedup, set<Value *> &taints);
 
@@ -211,18 +302,24 @@ class Slice {
 
   protected:
     // scope
-    set<BasicBlock *> &reach;
+    BlockSet &reach;
     set<Instruction *> scope;
 
+    // dependencies
+    DepIndex &deps;
+
     // taint 
     set<Value *> backs;
     set<Value *> roots;
 
+    // blocks with newly traced insts
+    set<BasicBlock *> dirty;
+
     // cache
     SliceBlock *entry;
     SliceBlock *basis;
 
-    map<BasicBlock *, SliceBlock *> cache;
+    DenseMap<BasicBlock *, SliceBlock *> cache;
     set<SliceBlock *> suits;
 };
 
@@ -236,8 +333,7 @@ class LLVMSliceBlock
 
   public:
     LLVMSliceBlock(LLVMSlice *slice, SliceBlock *block) 
-      : parent(slice), sb(block), bb(block->getBlock()),
-        insts(block->instBegin(), block->instEnd()) {} 
+      : parent(slice), sb(block), bb(block->getBlock()) {} 
 
     ~LLVMSliceBlock() {}
 
@@ -259,15 +355,15 @@ class LLVMSliceBlock
       return bb;
     }
 
-    // inst interation
-    typedef list<Instruction *>::iterator inst_iterator;
+    // inst interation, backed by the slice block
+    typedef SliceBlock::instIter inst_iterator;
 
     inst_iterator inst_begin() {
-      return insts.begin();
+      return sb->instBegin();
     }
 
     inst_iterator inst_end() {
-      return insts.end();
+      return sb->instEnd();
     }
 
     // links
@@ -414,7 +510,6 @@ class LLVMSliceBlock
     // insts
     SliceBlock *sb;
     BasicBlock *bb;
-    list<Instruction *> insts;
 
     // links
     vector<LLVMSliceBlock *> preds;
@@ -1,6 +1,14 @@
 // SPDX-License-Identifier: MIT
 #include "Project.h"
 
+// option setup
+static cl::opt<unsigned> QUERY_BUDGET("ksym-query-budget", cl::init(0),
+    cl::desc("milliseconds to spend on a solver query, 0 for unlimited"));
+
+static cl::opt<unsigned> SYM_REUSE("ksym-sym-reuse", cl::init(64),
+    cl::desc("number of checks a symbol engine serves before it is replaced, "
+      "its ASTs are only freed along with it"));
+
 // main
 SymExec::SymExec(ModuleOracle &m) 
   : mo(m) {
@@ -13,36 +21,69 @@ SymExec::SymExec(ModuleOracle &m)
   solver = Z3_mk_solver(ctxt);
   Z3_solver_inc_ref(ctxt, solver);
 
+  // a timed-out query is reported as undecided
+  if(QUERY_BUDGET.getValue() != 0){
+    Z3_params params = Z3_mk_params(ctxt);
+    Z3_params_inc_ref(ctxt, params);
+    Z3_params_set_uint(ctxt, params, 
+        Z3_mk_string_symbol(ctxt, "timeout"), QUERY_BUDGET.getValue());
+    Z3_solver_set_params(ctxt, solver, params);
+    Z3_params_dec_ref(ctxt, params);
+  }
+
   // create sorts
   unsigned ptrsz = mo.getPointerWidth(); 
   SORT_Pointer = Z3_mk_bv_sort(ctxt, ptrsz);
   sints[ptrsz] = SORT_Pointer;
 
-  SORT_MemSlot = Z3_mk_bv_sort(ctxt, mo.getBits());
+  // a memory slot holds a word of pointer width
+  assert(ptrsz % mo.getBits() == 0);
+  wsize = ptrsz / mo.getBits();
+  wlog = Log2_32(wsize);
+  assert((1u << wlog) == wsize);
+
+  SORT_MemSlot = SORT_Pointer;
   SORT_MemBlob = Z3_mk_array_sort(ctxt, SORT_Pointer, SORT_MemSlot);
 
   // symbol counter
   varcount = 0;
 
+  // query counters
+  presolved = 0;
+  solved = 0;
+
   // memory model
-  memory = Z3_mk_const(ctxt,
-      Z3_mk_string_symbol(ctxt, "memory"),
+  guard = nullptr;
+
+  memory[MEM_STACK] = Z3_mk_const(ctxt,
+      Z3_mk_string_symbol(ctxt, "memory.stack"),
+      SORT_MemBlob);
+
+  memory[MEM_EXTERN] = Z3_mk_const(ctxt,
+      Z3_mk_string_symbol(ctxt, "memory.extern"),
       SORT_MemBlob);
 
-  sptr = Z3_mk_bvmul(ctxt, createVarPointer(), createConstPointer(PAGE_SIZE));
+  memory[MEM_HEAP] = Z3_mk_const(ctxt,
+      Z3_mk_string_symbol(ctxt, "memory.heap"),
+      SORT_MemBlob);
+
+  rvars[MEM_STACK] = createVarPointer();
+  sptr = Z3_mk_bvmul(ctxt, rvars[MEM_STACK], createConstPointer(PAGE_SIZE));
   addAssert(Z3_mk_bvuge(ctxt, sptr, createConstPointer(STACK_BASE)));
 
-  eptr = Z3_mk_bvmul(ctxt, createVarPointer(), createConstPointer(PAGE_SIZE));
+  rvars[MEM_EXTERN] = createVarPointer();
+  eptr = Z3_mk_bvmul(ctxt, rvars[MEM_EXTERN], createConstPointer(PAGE_SIZE));
   addAssert(Z3_mk_bvuge(ctxt, eptr, createConstPointer(EXTERN_BASE)));
 
-  hptr = Z3_mk_bvmul(ctxt, createVarPointer(), createConstPointer(PAGE_SIZE));
+  rvars[MEM_HEAP] = createVarPointer();
+  hptr = Z3_mk_bvmul(ctxt, rvars[MEM_HEAP], createConstPointer(PAGE_SIZE));
   addAssert(Z3_mk_bvuge(ctxt, hptr, createConstPointer(HEAP_BASE)));
 }
 
 SymExec::~SymExec() {
   // clean up cache
-  for(auto const &i : cache){
-    delete i.second;
+  for(unsigned id : order){
+    delete cache[id];
   }
 
   // destroy z3
@@ -57,11 +98,125 @@ void SymExec::complete() {
   addAssert(Z3_mk_bvule(ctxt, hptr, createConstPointer(HEAP_TERM)));
 }
 
+SymVar *SymExec::getOrCreateVar(SENode *node, bool &exist) {
+  unsigned id = node->getId();
+  if(id >= cache.size()){
+    cache.resize(id + 1, nullptr);
+  }
+
+  if(cache[id] != nullptr){
+    exist = true;
+    return cache[id];
+  }
+
+  exist = false;
+  SymVar *var = new SymVar();
+  cache[id] = var;
+  order.push_back(id);
+  return var;
+}
+
+SymVar *SymExec::getVar(SENode *node) {
+  unsigned id = node->getId();
+  if(id >= cache.size()){
+    return nullptr;
+  } else {
+    return cache[id];
+  }
+}
+
+void SymExec::push() {
+  Scope scope;
+  for(unsigned r = 0; r < MEM_NUM; r++){
+    scope.memory[r] = memory[r];
+  }
+  scope.sptr = sptr;
+  scope.eptr = eptr;
+  scope.hptr = hptr;
+  scope.guard = guard;
+  scope.sints = sints;
+  scope.vars = order.size();
+
+  scopes.push_back(scope);
+  Z3_solver_push(ctxt, solver);
+}
+
+void SymExec::pop() {
+  assert(!scopes.empty());
+  Scope &scope = scopes.back();
+
+  Z3_solver_pop(ctxt, solver, 1);
+
+  // drop the symbols created in the scope
+  for(unsigned i = scope.vars; i < order.size(); i++){
+    delete cache[order[i]];
+    cache[order[i]] = nullptr;
+  }
+  order.resize(scope.vars);
+
+  for(unsigned r = 0; r < MEM_NUM; r++){
+    memory[r] = scope.memory[r];
+  }
+  sptr = scope.sptr;
+  eptr = scope.eptr;
+  hptr = scope.hptr;
+  guard = scope.guard;
+  sints = scope.sints;
+
+  scopes.pop_back();
+}
+
+// engine pool
+struct SymSlot {
+  SymExec *sym;
+  unsigned served;
+  bool leased;
+
+  SymSlot() : sym(nullptr), served(0), leased(false) {}
+
+  ~SymSlot() {
+    delete sym;
+  }
+};
+
+static thread_local SymSlot SLOT;
+
+SymLease::SymLease(ModuleOracle &m) {
+  assert(!SLOT.leased);
+
+  // the context only grows, so retire the engine once in a while
+  if(SLOT.sym != nullptr && 
+      (&SLOT.sym->getOracle() != &m || SLOT.served >= SYM_REUSE)){
+    delete SLOT.sym;
+    SLOT.sym = nullptr;
+  }
+
+  if(SLOT.sym == nullptr){
+    SLOT.sym = new SymExec(m);
+    SLOT.served = 0;
+  }
+
+  SLOT.leased = true;
+
+  sym = SLOT.sym;
+  sym->push();
+}
+
+SymLease::~SymLease() {
+  sym->pop();
+
+  SLOT.served++;
+  SLOT.leased = false;
+}
+
 // symbolize the SEG
 void SEGraph::symbolize(SymExec &sym) {
   // symbolize all leaf and var nodes
-  for(auto &i : nodes){
-    SENode *node = i.second;
+  for(SENode *node : byid){
+    if(node == nullptr){
+      continue;
+    }
+
     if(isa<SENodeLeaf>(node) || isa<SENodeVar>(node)){
       node->getSymbol(sym);
     }
@@ -78,14 +233,209 @@ void SEGraph::symbolize(SymExec &sym) {
       continue;
     }
 
+    // in a merged graph, the effects of a node only hold on the paths 
+    // through its block
+    if(merged){
+      sym.setGuard(getGuard(sym, c));
+    }
+
     // symbolize the node
     node->getSymbol(sym);
   }
 
+  // a merged graph covers the paths reaching the end of the trace only
+  if(merged){
+    sym.setGuard(nullptr);
+    sym.addAssert(getGuard(sym, len - 1));
+  }
+
   // finish up
   sym.complete();
 }
 
+void SEGraph::symbolize(SymExec &sym, int from, int to) {
+  // leaf and var nodes are symbolized on demand as dependencies
+  for(int c = from; c < to; c++){
+    SENode *node = getNodeOrNull(c, trace.at(c));
+    if(node != nullptr){
+      node->getSymbol(sym);
+    }
+  }
+}
+
+// scalar evolution
+Z3_ast SEGraph::symbolizeSCEV(SymExec &sym, const SCEV *expr) {
+  Z3_context ctxt = sym.getContext();
+  unsigned width = sym.getOracle().getTypeWidth(expr->getType());
+
+  if(const SCEVConstant *c = dyn_cast<SCEVConstant>(expr)){
+    return sym.createConstMachInt(c->getValue());
+  }
+
+  if(const SCEVUnknown *u = dyn_cast<SCEVUnknown>(expr)){
+    SENode *node = getNodeProbe(u->getValue());
+    SymVar *svar = node == nullptr ? nullptr : sym.getVar(node);
+    if(svar == nullptr || !svar->ready()){
+      return nullptr;
+    }
+
+    return svar->getSingleVal()->getExpr().expr;
+  }
+
+  if(const SCEVCastExpr *c = dyn_cast<SCEVCastExpr>(expr)){
+    Z3_ast op = symbolizeSCEV(sym, c->getOperand());
+    if(op == nullptr){
+      return nullptr;
+    }
+
+    if(isa<SCEVTruncateExpr>(c)){
+      return sym.castMachIntTrunc(op, width);
+    } 
+    
+    if(isa<SCEVZeroExtendExpr>(c)){
+      return sym.castMachIntZExt(op, width);
+    }
+
+    if(isa<SCEVSignExtendExpr>(c)){
+      return sym.castMachIntSExt(op, width);
+    }
+
+    return nullptr;
+  }
+
+  if(const SCEVUDivExpr *d = dyn_cast<SCEVUDivExpr>(expr)){
+    Z3_ast lhs = symbolizeSCEV(sym, d->getLHS());
+    Z3_ast rhs = symbolizeSCEV(sym, d->getRHS());
+    if(lhs == nullptr || rhs == nullptr){
+      return nullptr;
+    }
+
+    return Z3_mk_bvudiv(ctxt, lhs, rhs);
+  }
+
+  // add, mul and max, but not add recurrences, which are not loop-invariant
+  if(isa<SCEVCommutativeExpr>(expr)){
+    const SCEVNAryExpr *n = cast<SCEVNAryExpr>(expr);
+
+    Z3_ast res = nullptr;
+    for(const SCEV *o : n->operands()){
+      Z3_ast op = symbolizeSCEV(sym, o);
+      if(op == nullptr){
+        return nullptr;
+      }
+
+      if(res == nullptr){
+        res = op;
+      } else if(isa<SCEVAddExpr>(n)){
+        res = Z3_mk_bvadd(ctxt, res, op);
+      } else if(isa<SCEVMulExpr>(n)){
+        res = Z3_mk_bvmul(ctxt, res, op);
+      } else if(isa<SCEVUMaxExpr>(n)){
+        res = Z3_mk_ite(ctxt, Z3_mk_bvugt(ctxt, res, op), res, op);
+      } else if(isa<SCEVSMaxExpr>(n)){
+        res = Z3_mk_ite(ctxt, Z3_mk_bvsgt(ctxt, res, op), res, op);
+      } else {
+        return nullptr;
+      }
+    }
+
+    return res;
+  }
+
+  return nullptr;
+}
+
+// path guards
+Z3_ast SEGraph::getGuard(SymExec &sym, SliceBlock *block) {
+  assert(merged && region.find(block) != region.end());
+
+  auto i = guards.find(block);
+  if(i != guards.end()){
+    return i->second;
+  }
+
+  // a block is reached through any of its edges from within the region, 
+  // the root of the region is always reached
+  vector<Z3_ast> edges;
+
+  SliceBlock::linkIter pi = block->predBegin(), pe = block->predEnd();
+  for(; pi != pe; ++pi){
+    if(region.find(*pi) != region.end()){
+      edges.push_back(getEdgeGuard(sym, *pi, block));
+    }
+  }
+
+  Z3_ast res;
+  if(edges.empty()){
+    res = sym.createConstBool(true);
+  } else if(edges.size() == 1){
+    res = edges[0];
+  } else {
+    res = Z3_mk_or(sym.getContext(), edges.size(), edges.data());
+  }
+
+  guards.insert(make_pair(block, res));
+  return res;
+}
+
+Z3_ast SEGraph::getGuard(SymExec &sym, int seq) {
+  SliceBlock *host = so.getSliceHost(trace.at(seq));
+  assert(host != nullptr);
+
+  return getGuard(sym, host);
+}
+
+Z3_ast SEGraph::getEdgeGuard(SymExec &sym, SliceBlock *from, 
+    SliceBlock *to) {
+
+  Z3_ast guard = getGuard(sym, from);
+
+  Z3_ast cond = getExitCond(sym, from);
+  if(cond == nullptr){
+    return guard;
+  }
+
+  BranchInst *branch = cast<BranchInst>(from->getBlock()->getTerminator());
+  bool tval = from->inSTab(to, branch->getSuccessor(0));
+  bool fval = from->inSTab(to, branch->getSuccessor(1));
+
+  // both directions lead to the block
+  if(tval && fval){
+    return guard;
+  }
+
+  Z3_ast args[2];
+  args[0] = guard;
+  args[1] = tval ? cond : Z3_mk_not(sym.getContext(), cond);
+  return Z3_mk_and(sym.getContext(), 2, args);
+}
+
+Z3_ast SEGraph::getExitCond(SymExec &sym, SliceBlock *block) {
+  auto i = exits.find(block);
+  if(i != exits.end()){
+    return i->second;
+  }
+
+  Z3_ast res = nullptr;
+
+  BranchInst *branch = dyn_cast<BranchInst>(block->getBlock()->getTerminator());
+  if(branch != nullptr && branch->isConditional()){
+    SENode *node = getNodeProbe(branch->getCondition());
+    SymVar *svar = node == nullptr ? nullptr : sym.getVar(node);
+
+    if(svar != nullptr && svar->ready()){
+      res = sym.castMachIntToBool(svar->getSingleVal()->getExpr().expr);
+    } else {
+      // the condition is unknown, but the two directions still exclude 
+      // each other
+      res = sym.createVarBool();
+    }
+  }
+
+  exits.insert(make_pair(block, res));
+  return res;
+}
+
 static inline void replayNode(SENode *node, 
     SymExec &sym, Z3_context ctxt, Z3_model model) {
 
@@ -111,14 +461,12 @@ static inline void replayNode(SENode *node,
 #endif
 }
 
-void SEGraph::replay(SymExec &sym) {
+void SEGraph::replay(SymExec &sym, Z3_model model) {
   Z3_context ctxt = sym.getContext();
-  Z3_model model = sym.getModel();
 
   // dump all var nodes
-  for(auto &i : nodes){
-    SENode *node = i.second;
-    if(isa<SENodeVar>(node)){
+  for(SENode *node : byid){
+    if(node != nullptr && isa<SENodeVar>(node)){
       replayNode(node, sym, ctxt, model);
     }
   }
@@ -140,32 +488,24 @@ void SEGraph::replay(SymExec &sym) {
 }
 
 // checks
-CheckResult SymExec::checkOverlap(
-    SymVar *src1, SymVar *len1,
-    SymVar *src2, SymVar *len2) {
-
+bool SymExec::prepareRange(SymVar *src, SymVar *len, Z3_ast &s, Z3_ast &l) {
   // make sure that their symbolic exprs exist
-  if(src1 == nullptr || len1 == nullptr || src2 == nullptr || len2 == nullptr){
-    return CK_SYMERR;
+  if(src == nullptr || len == nullptr){
+    return false;
   }
 
-  Z3_ast s1 = src1->getSingleVal()->getExpr().expr;
-  Z3_ast l1 = len1->getSingleVal()->getExpr().expr;
-  Z3_ast s2 = src2->getSingleVal()->getExpr().expr;
-  Z3_ast l2 = len2->getSingleVal()->getExpr().expr;
+  s = src->getSingleVal()->getExpr().expr;
+  l = len->getSingleVal()->getExpr().expr;
 
   // NOTE: special treatment on 32bit size
-  if(!isPointerSort(l1)){
-    l1 = castMachIntZExt(l1, mo.getPointerWidth());
+  if(!isPointerSort(l)){
+    l = castMachIntZExt(l, mo.getPointerWidth());
   }
 
-  if(!isPointerSort(l2)){
-    l2 = castMachIntZExt(l2, mo.getPointerWidth());
-  }
-
-  // the actual solver
-  Z3_lbool result = checkOverlap(s1, l1, s2, l2);
+  return true;
+}
 
+static inline CheckResult toCheckResult(Z3_lbool result) {
   switch(result){
     case Z3_L_TRUE:
       return CK_SAT;
@@ -181,23 +521,96 @@ CheckResult SymExec::checkOverlap(
   return CK_SYMERR;
 }
 
-Z3_lbool SymExec::checkOverlap(
-    Z3_ast s1, Z3_ast l1,
+CheckResult SymExec::checkOverlap(
+    SymVar *src1, SymVar *len1,
+    SymVar *src2, SymVar *len2) {
+
+  Z3_ast s1, l1, s2, l2;
+  if(!prepareRange(src1, len1, s1, l1) || !prepareRange(src2, len2, s2, l2)){
+    return CK_SYMERR;
+  }
+
+  // settled without the overlap formula if possible
+  switch(preCheckOverlap(s1, l1, s2, l2)){
+    case Z3_L_FALSE:
+      presolved++;
+      return CK_UNSAT;
+
+    case Z3_L_TRUE:
+      presolved++;
+      return toCheckResult(Z3_solver_check(ctxt, solver));
+
+    case Z3_L_UNDEF:
+      break;
+  }
+
+  // the actual solver
+  solved++;
+  return toCheckResult(checkOverlap(s1, l1, s2, l2));
+}
+
+void SymExec::checkOverlaps(
+    SymVar *src1, SymVar *len1,
+    vector<pair<SymVar *, SymVar *>> &others,
+    vector<Z3_ast> &conds,
+    vector<CheckResult> &results,
+    vector<Z3_model> *models) {
+
+  results.assign(others.size(), CK_SYMERR);
+  if(models != nullptr){
+    models->assign(others.size(), nullptr);
+  }
+
+  Z3_ast s1, l1;
+  if(!prepareRange(src1, len1, s1, l1)){
+    return;
+  }
+
+  vector<pair<Z3_ast, Z3_ast>> ranges;
+  vector<Z3_ast> rconds;
+  vector<unsigned> index;
+
+  for(unsigned i = 0; i < others.size(); i++){
+    Z3_ast s2, l2;
+    if(prepareRange(others[i].first, others[i].second, s2, l2)){
+      ranges.push_back(make_pair(s2, l2));
+      index.push_back(i);
+
+      if(!conds.empty()){
+        rconds.push_back(conds[i]);
+      }
+    }
+  }
+
+  if(ranges.empty()){
+    return;
+  }
+
+  // the actual solver
+  vector<Z3_lbool> solved;
+  vector<Z3_model> held;
+  checkOverlaps(s1, l1, ranges, rconds, solved, 
+      models == nullptr ? nullptr : &held);
+
+  for(unsigned i = 0; i < index.size(); i++){
+    results[index[i]] = toCheckResult(solved[i]);
+    if(models != nullptr){
+      (*models)[index[i]] = held[i];
+    }
+  }
+}
+
+Z3_ast SymExec::createOverlap(
+    Z3_ast s1, Z3_ast l1, 
     Z3_ast s2, Z3_ast l2) {
 
   // sanity check
   assert(isPointerSort(s1) && isPointerSort(l1) && 
       isPointerSort(s2) && isPointerSort(l2));
 
-  // save context
-  Z3_solver_push(ctxt, solver);
-
   // condition: (s2 <= s1 < s2 + l2) || (s1 <= s2 < s1 + l1)
   Z3_ast d1 = Z3_mk_bvadd(ctxt, s1, l1);
-  addAssert(Z3_mk_bvadd_no_overflow(ctxt, s1, l1, false));
-
   Z3_ast d2 = Z3_mk_bvadd(ctxt, s2, l2);
-  addAssert(Z3_mk_bvadd_no_overflow(ctxt, s2, l2, false));
 
   Z3_ast cls[2];
 
@@ -211,7 +624,22 @@ Z3_lbool SymExec::checkOverlap(
   c2[1] = Z3_mk_bvult(ctxt, s2, d1);
   cls[1] = Z3_mk_and(ctxt, 2, c2);
 
-  addAssert(Z3_mk_or(ctxt, 2, cls));
+  Z3_ast res[3];
+  res[0] = Z3_mk_bvadd_no_overflow(ctxt, s1, l1, false);
+  res[1] = Z3_mk_bvadd_no_overflow(ctxt, s2, l2, false);
+  res[2] = Z3_mk_or(ctxt, 2, cls);
+
+  return Z3_mk_and(ctxt, 3, res);
+}
+
+Z3_lbool SymExec::checkOverlap(
+    Z3_ast s1, Z3_ast l1,
+    Z3_ast s2, Z3_ast l2) {
+
+  // save context
+  Z3_solver_push(ctxt, solver);
+
+  addAssert(createOverlap(s1, l1, s2, l2));
 
   // solve
   Z3_lbool result = Z3_solver_check(ctxt, solver);
@@ -221,3 +649,563 @@ Z3_lbool SymExec::checkOverlap(
 
   return result;
 }
+
+void SymExec::checkOverlaps(
+    Z3_ast s1, Z3_ast l1,
+    vector<pair<Z3_ast, Z3_ast>> &others,
+    vector<Z3_ast> &conds,
+    vector<Z3_lbool> &results,
+    vector<Z3_model> *models) {
+
+  results.assign(others.size(), Z3_L_UNDEF);
+  if(models != nullptr){
+    models->assign(others.size(), nullptr);
+  }
+
+  // settle what can be settled without the overlap formulas first, the
+  // pairs that overlap regardless of the trace share a feasibility check,
+  // unless they are fetched under a condition
+  vector<unsigned> pending, feasible;
+  vector<Z3_ast> facts;
+  unsigned undecided = 0;
+
+  for(unsigned i = 0; i < others.size(); i++){
+    Z3_ast cond = conds.empty() ? nullptr : conds[i];
+    Z3_ast fact;
+
+    switch(preCheckOverlap(s1, l1, others[i].first, others[i].second)){
+      case Z3_L_FALSE:
+        results[i] = Z3_L_FALSE;
+        break;
+
+      case Z3_L_TRUE:
+        if(cond == nullptr){
+          feasible.push_back(i);
+        } else {
+          pending.push_back(i);
+          facts.push_back(cond);
+        }
+        break;
+
+      case Z3_L_UNDEF:
+        undecided++;
+
+        fact = createOverlap(s1, l1, others[i].first, others[i].second);
+        if(cond != nullptr){
+          Z3_ast args[2] = {cond, fact};
+          fact = Z3_mk_and(ctxt, 2, args);
+        }
+
+        pending.push_back(i);
+        facts.push_back(fact);
+        break;
+    }
+  }
+
+  presolved += others.size() - undecided;
+  solved += undecided;
+
+  if(!feasible.empty()){
+    Z3_lbool result = Z3_solver_check(ctxt, solver);
+    for(unsigned i : feasible){
+      results[i] = result;
+      if(models != nullptr && result == Z3_L_TRUE){
+        (*models)[i] = holdModel();
+      }
+    }
+  }
+
+  if(pending.empty()){
+    return;
+  }
+
+  // save context
+  Z3_solver_push(ctxt, solver);
+
+  // guard each overlap with an indicator, so that all pairs are decided
+  // under assumptions against the same assertions, sharing learned clauses
+  vector<Z3_ast> indicators;
+
+  for(Z3_ast fact : facts){
+    Z3_ast indicator = createVarBool();
+    addAssert(Z3_mk_implies(ctxt, indicator, fact));
+    indicators.push_back(indicator);
+  }
+
+  // solve
+  for(unsigned k = 0; k < pending.size(); k++){
+    results[pending[k]] = 
+      Z3_solver_check_assumptions(ctxt, solver, 1, &indicators[k]);
+
+    // the model is only that of this pair until the next check
+    if(models != nullptr && results[pending[k]] == Z3_L_TRUE){
+      (*models)[pending[k]] = holdModel();
+    }
+  }
+
+  // restore context
+  Z3_solver_pop(ctxt, solver, 1);
+}
+
+// affine pre-check
+bool SymExec::getConstValue(Z3_ast expr, __uint64 &val) {
+  if(!Z3_is_numeral_ast(ctxt, expr)){
+    return false;
+  }
+
+  return Z3_get_numeral_uint64(ctxt, expr, &val);
+}
+
+void SymExec::getAffineForm(Z3_ast expr, Z3_ast &base, __uint64 &off) {
+  unsigned width = getExprSortWidth(expr);
+  __uint64 mask = width >= 64 ? ~__uint64(0) : (__uint64(1) << width) - 1;
+
+  __uint64 val;
+  if(getConstValue(expr, val)){
+    base = nullptr;
+    off = val;
+    return;
+  }
+
+  // by default, the expr itself is the base
+  base = expr;
+  off = 0;
+
+  if(Z3_get_ast_kind(ctxt, expr) != Z3_APP_AST){
+    return;
+  }
+
+  Z3_app app = Z3_to_app(ctxt, expr);
+  Z3_decl_kind kind = Z3_get_decl_kind(ctxt, Z3_get_app_decl(ctxt, app));
+  unsigned num = Z3_get_app_num_args(ctxt, app);
+
+  // base + c1 + c2 + ...
+  if(kind == Z3_OP_BADD){
+    Z3_ast sym = nullptr;
+    __uint64 sum = 0;
+
+    for(unsigned i = 0; i < num; i++){
+      Z3_ast arg = Z3_get_app_arg(ctxt, app, i);
+
+      if(getConstValue(arg, val)){
+        sum = (sum + val) & mask;
+      } else if(sym == nullptr){
+        sym = arg;
+      } else {
+        return;
+      }
+    }
+
+    base = sym;
+    off = sum;
+  }
+
+  // base - c
+  else if(kind == Z3_OP_BSUB && num == 2){
+    Z3_ast arg = Z3_get_app_arg(ctxt, app, 0);
+    __uint64 lhs;
+    if(getConstValue(Z3_get_app_arg(ctxt, app, 1), val) && 
+        !getConstValue(arg, lhs)){
+
+      base = arg;
+      off = (0 - val) & mask;
+    }
+  }
+}
+
+Z3_lbool SymExec::preCheckOverlap(
+    Z3_ast s1, Z3_ast l1,
+    Z3_ast s2, Z3_ast l2) {
+
+  // lengths must be known
+  __uint64 n1, n2;
+  if(!getConstValue(Z3_simplify(ctxt, l1), n1) || 
+      !getConstValue(Z3_simplify(ctxt, l2), n2)){
+    return Z3_L_UNDEF;
+  }
+
+  // sources must differ by a known offset
+  Z3_ast b1, b2;
+  __uint64 o1, o2;
+  getAffineForm(s1, b1, o1);
+  getAffineForm(s2, b2, o2);
+
+  if(b1 != b2 && (b1 == nullptr || b2 == nullptr || 
+        !Z3_is_eq_ast(ctxt, b1, b2))){
+    return Z3_L_UNDEF;
+  }
+
+  unsigned width = getExprSortWidth(s1);
+  __uint64 mask = width >= 64 ? ~__uint64(0) : (__uint64(1) << width) - 1;
+
+  // whatever the base is, s2 - s1 == d and s1 - s2 == e modulo 2^width, so
+  // the ranges can only overlap when s1 <= s2 < s1 + l1 with s2 - s1 == d,
+  // or when s2 <= s1 < s2 + l2 with s1 - s2 == e
+  __uint64 d = (o2 - o1) & mask;
+  __uint64 e = (o1 - o2) & mask;
+
+  if(d >= n1 && e >= n2){
+    return Z3_L_FALSE;
+  }
+
+  // with a symbolic base, wrap-arounds and overflows depend on the trace
+  if(b1 != nullptr){
+    return Z3_L_UNDEF;
+  }
+
+  // concrete ranges, the overlap is decided but the trace still needs to
+  // be feasible
+  if(n1 > mask - o1 || n2 > mask - o2){
+    return Z3_L_FALSE;
+  }
+
+  if((o1 <= o2 && o2 - o1 < n1) || (o2 <= o1 && o1 - o2 < n2)){
+    return Z3_L_TRUE;
+  }
+
+  return Z3_L_FALSE;
+}
+
+// memory regions
+MemRegion SymExec::getRegion(Z3_ast addr) {
+  DenseMap<Z3_ast, unsigned> seen;
+  unsigned reg = traceRegion(addr, seen);
+  return reg < MEM_NUM ? MemRegion(reg) : MEM_NUM;
+}
+
+// the region of the only region base the expr is made of, MEM_NUM if it
+// has none, and MEM_NUM + 1 if it mixes some, the values loaded from memory
+// and the conditions of an ite do not count
+unsigned SymExec::traceRegion(Z3_ast expr, 
+    DenseMap<Z3_ast, unsigned> &seen) {
+
+  auto i = seen.find(expr);
+  if(i != seen.end()){
+    return i->second;
+  }
+
+  unsigned res = MEM_NUM;
+
+  if(Z3_get_ast_kind(ctxt, expr) == Z3_APP_AST){
+    Z3_app app = Z3_to_app(ctxt, expr);
+    Z3_decl_kind kind = Z3_get_decl_kind(ctxt, Z3_get_app_decl(ctxt, app));
+    unsigned num = Z3_get_app_num_args(ctxt, app);
+
+    if(num == 0){
+      for(unsigned r = 0; r < MEM_NUM; r++){
+        if(Z3_is_eq_ast(ctxt, expr, rvars[r])){
+          res = r;
+        }
+      }
+    }
+
+    else if(kind == Z3_OP_SELECT){
+      // loaded, may point anywhere
+    }
+
+    // both branches must agree
+    else if(kind == Z3_OP_ITE){
+      unsigned r1 = traceRegion(Z3_get_app_arg(ctxt, app, 1), seen);
+      unsigned r2 = traceRegion(Z3_get_app_arg(ctxt, app, 2), seen);
+      res = r1 == r2 ? r1 : MEM_NUM + 1;
+    }
+
+    // only the minuend may carry a region
+    else if(kind == Z3_OP_BSUB && num == 2){
+      unsigned r1 = traceRegion(Z3_get_app_arg(ctxt, app, 1), seen);
+      res = r1 == MEM_NUM 
+        ? traceRegion(Z3_get_app_arg(ctxt, app, 0), seen) : MEM_NUM + 1;
+    }
+
+    else {
+      for(unsigned k = 0; k < num && res <= MEM_NUM; k++){
+        unsigned r = traceRegion(Z3_get_app_arg(ctxt, app, k), seen);
+        if(r == MEM_NUM || r == res){
+          continue;
+        }
+
+        res = res == MEM_NUM ? r : MEM_NUM + 1;
+      }
+    }
+  }
+
+  seen[expr] = res;
+  return res;
+}
+
+Z3_ast SymExec::inRegion(MemRegion reg, Z3_ast addr) {
+  Z3_ast args[2];
+
+  switch(reg){
+    case MEM_STACK:
+      args[0] = Z3_mk_bvuge(ctxt, addr, createConstPointer(STACK_BASE));
+      args[1] = Z3_mk_bvult(ctxt, addr, createConstPointer(STACK_TERM));
+      return Z3_mk_and(ctxt, 2, args);
+
+    case MEM_HEAP:
+      args[0] = Z3_mk_bvuge(ctxt, addr, createConstPointer(HEAP_BASE));
+      args[1] = Z3_mk_bvult(ctxt, addr, createConstPointer(HEAP_TERM));
+      return Z3_mk_and(ctxt, 2, args);
+
+    // everything else, including the constant addresses
+    case MEM_EXTERN:
+      args[0] = inRegion(MEM_STACK, addr);
+      args[1] = inRegion(MEM_HEAP, addr);
+      return Z3_mk_not(ctxt, Z3_mk_or(ctxt, 2, args));
+
+    default:
+      llvm_unreachable("Unknown memory region");
+  }
+}
+
+// word-level access
+bool SymExec::isWordAligned(Z3_ast expr) {
+  __uint64 val;
+  if(getConstValue(expr, val)){
+    return val % wsize == 0;
+  }
+
+  if(Z3_get_ast_kind(ctxt, expr) != Z3_APP_AST){
+    return false;
+  }
+
+  Z3_app app = Z3_to_app(ctxt, expr);
+  Z3_decl_kind kind = Z3_get_decl_kind(ctxt, Z3_get_app_decl(ctxt, app));
+  unsigned num = Z3_get_app_num_args(ctxt, app);
+
+  switch(kind){
+    // a sum of aligned terms
+    case Z3_OP_BADD:
+      for(unsigned i = 0; i < num; i++){
+        if(!isWordAligned(Z3_get_app_arg(ctxt, app, i))){
+          return false;
+        }
+      }
+      return true;
+
+    // a product with an aligned term
+    case Z3_OP_BMUL:
+      for(unsigned i = 0; i < num; i++){
+        if(isWordAligned(Z3_get_app_arg(ctxt, app, i))){
+          return true;
+        }
+      }
+      return false;
+
+    // shifted by at least the word
+    case Z3_OP_BSHL:
+      return getConstValue(Z3_get_app_arg(ctxt, app, 1), val) && val >= wlog;
+
+    // aligned low bits
+    case Z3_OP_CONCAT: {
+      Z3_ast low = Z3_get_app_arg(ctxt, app, num - 1);
+      return getExprSortWidth(low) >= wlog && isWordAligned(low);
+    }
+
+    default:
+      return false;
+  }
+}
+
+// split the addr into the address of its first word, as base + off, and 
+// the offset within it, -1 if that is only known at run time
+int SymExec::getWordForm(Z3_ast addr, Z3_ast &base, __uint64 &off) {
+  Z3_ast b;
+  __uint64 o;
+  getAffineForm(Z3_simplify(ctxt, addr), b, o);
+
+  if(b == nullptr || wsize == 1 || isWordAligned(b)){
+    base = b;
+    off = o - o % wsize;
+    return o % wsize;
+  }
+
+  base = Z3_mk_bvand(ctxt, addr, 
+      createConstMachIntSigned(-__int64(wsize), getExprSortWidth(addr)));
+  off = 0;
+  return -1;
+}
+
+Z3_ast SymExec::getWordAddr(Z3_ast base, __uint64 off) {
+  unsigned width = mo.getPointerWidth();
+  __uint64 mask = width >= 64 ? ~__uint64(0) : (__uint64(1) << width) - 1;
+
+  if(base == nullptr){
+    return createConstPointer(off & mask);
+  }
+
+  if((off & mask) == 0){
+    return base;
+  }
+
+  return Z3_mk_bvadd(ctxt, base, createConstPointer(off & mask));
+}
+
+// the shift, in bits, of an access within num words starting at the word
+// of the addr
+Z3_ast SymExec::getWordShift(Z3_ast addr, unsigned num) {
+  unsigned width = num * wsize * mo.getBits();
+
+  Z3_ast res = Z3_mk_extract(ctxt, wlog - 1, 0, addr);
+  res = Z3_mk_zero_ext(ctxt, width - wlog, res);
+  return Z3_mk_bvmul(ctxt, res, 
+      createConstMachIntUnsigned(mo.getBits(), width));
+}
+
+Z3_ast SymExec::loadRegion(MemRegion reg, Z3_ast addr, unsigned size) {
+  unsigned bits = mo.getBits();
+
+  Z3_ast base;
+  __uint64 off;
+  int rem = getWordForm(addr, base, off);
+
+  // the words covering the access, the first at the lowest bits
+  unsigned num = rem < 0 
+    ? (size + wsize - 1) / wsize + 1 
+    : (rem + size + wsize - 1) / wsize;
+
+  Z3_ast res = nullptr, cur;
+  for(unsigned i = 0; i < num; i++){
+    cur = Z3_mk_select(ctxt, memory[reg], getWordAddr(base, off + i * wsize));
+    res = res == nullptr ? cur : Z3_mk_concat(ctxt, cur, res);
+  }
+
+  // an aligned word
+  if(rem == 0 && size == wsize){
+    return res;
+  }
+
+  if(rem >= 0){
+    return Z3_mk_extract(ctxt, (rem + size) * bits - 1, rem * bits, res);
+  }
+
+  res = Z3_mk_bvlshr(ctxt, res, getWordShift(addr, num));
+  return Z3_mk_extract(ctxt, size * bits - 1, 0, res);
+}
+
+Z3_ast SymExec::storeRegion(MemRegion reg, Z3_ast addr, Z3_ast expr) {
+  unsigned bits = mo.getBits();
+  unsigned size = getExprSortSize(expr);
+
+  Z3_ast base;
+  __uint64 off;
+  int rem = getWordForm(addr, base, off);
+
+  Z3_ast mem = memory[reg];
+  Z3_ast loc, val, old;
+
+  // an aligned word
+  if(rem == 0 && size == wsize){
+    return Z3_mk_store(ctxt, mem, getWordAddr(base, off), expr);
+  }
+
+  // splice the bytes into the words they cover
+  if(rem >= 0){
+    unsigned num = (rem + size + wsize - 1) / wsize;
+
+    for(unsigned i = 0; i < num; i++){
+      // the bytes [lo, hi) of the word are overridden
+      unsigned at = i * wsize;
+      unsigned lo = max<unsigned>(rem, at) - at;
+      unsigned hi = min<unsigned>(rem + size, at + wsize) - at;
+
+      loc = getWordAddr(base, off + at);
+      val = Z3_mk_extract(ctxt, 
+          (at + hi - rem) * bits - 1, (at + lo - rem) * bits, 
+          expr);
+
+      if(lo != 0 || hi != wsize){
+        old = Z3_mk_select(ctxt, memory[reg], loc);
+
+        if(hi != wsize){
+          val = Z3_mk_concat(ctxt, 
+              Z3_mk_extract(ctxt, wsize * bits - 1, hi * bits, old), val);
+        }
+
+        if(lo != 0){
+          val = Z3_mk_concat(ctxt, 
+              val, Z3_mk_extract(ctxt, lo * bits - 1, 0, old));
+        }
+      }
+
+      mem = Z3_mk_store(ctxt, mem, loc, val);
+    }
+
+    return mem;
+  }
+
+  // merge the bytes into the words under a mask shifted at run time
+  unsigned num = (size + wsize - 1) / wsize + 1;
+  unsigned width = num * wsize * bits;
+
+  old = nullptr;
+  for(unsigned i = 0; i < num; i++){
+    loc = Z3_mk_select(ctxt, memory[reg], getWordAddr(base, off + i * wsize));
+    old = old == nullptr ? loc : Z3_mk_concat(ctxt, loc, old);
+  }
+
+  Z3_ast sft = getWordShift(addr, num);
+
+  Z3_ast msk = createConstMachIntSigned(-1, size * bits);
+  msk = Z3_mk_zero_ext(ctxt, width - size * bits, msk);
+  msk = Z3_mk_bvshl(ctxt, msk, sft);
+
+  val = Z3_mk_zero_ext(ctxt, width - size * bits, expr);
+  val = Z3_mk_bvshl(ctxt, val, sft);
+  val = Z3_mk_bvor(ctxt, Z3_mk_bvand(ctxt, old, Z3_mk_bvnot(ctxt, msk)), val);
+
+  for(unsigned i = 0; i < num; i++){
+    mem = Z3_mk_store(ctxt, mem, getWordAddr(base, off + i * wsize),
+        Z3_mk_extract(ctxt, (i + 1) * wsize * bits - 1, i * wsize * bits, val));
+  }
+
+  return mem;
+}
+
+// memory access
+Z3_ast SymExec::loadMemory(Z3_ast addr, unsigned size) {
+  assert(isPointerSort(addr) && size != 0);
+
+  MemRegion reg = getRegion(addr);
+  if(reg != MEM_NUM){
+    return loadRegion(reg, addr, size);
+  }
+
+  // unknown region, dispatch by the address range
+  Z3_ast res = loadRegion(MEM_EXTERN, addr, size);
+  res = Z3_mk_ite(ctxt, inRegion(MEM_HEAP, addr), 
+      loadRegion(MEM_HEAP, addr, size), res);
+  res = Z3_mk_ite(ctxt, inRegion(MEM_STACK, addr), 
+      loadRegion(MEM_STACK, addr, size), res);
+
+  return res;
+}
+
+void SymExec::storeMemory(Z3_ast addr, Z3_ast expr) {
+  // sub-byte values (e.g., a stored i1) take up whole bytes
+  unsigned width = getExprSortWidth(expr);
+  if(width % mo.getBits() != 0){
+    expr = Z3_mk_zero_ext(ctxt, mo.getBits() - width % mo.getBits(), expr);
+  }
+
+  MemRegion reg = getRegion(addr);
+
+  Z3_ast mem, cond, args[2];
+  for(unsigned r = 0; r < MEM_NUM; r++){
+    if(reg != MEM_NUM && reg != MemRegion(r)){
+      continue;
+    }
+
+    mem = storeRegion(MemRegion(r), addr, expr);
+
+    // unknown region, only the region the addr falls in is overridden
+    cond = guard;
+    if(reg == MEM_NUM){
+      args[0] = inRegion(MemRegion(r), addr);
+      args[1] = guard;
+      cond = guard == nullptr ? args[0] : Z3_mk_and(ctxt, 2, args);
+    }
+
+    memory[r] = cond == nullptr ? mem : Z3_mk_ite(ctxt, cond, mem, memory[r]);
+  }
+}
@@ -162,6 +162,14 @@ class SymVar {
     set<SymVal *> vals;
 };
 
+// memory regions, MEM_NUM when a pointer cannot be tied to one
+enum MemRegion {
+  MEM_STACK       = 0,
+  MEM_EXTERN      = 1,
+  MEM_HEAP        = 2,
+  MEM_NUM         = 3
+};
+
 enum CheckResult {
   // solver return
   CK_SAT          = 0,
@@ -330,6 +338,10 @@ class SymExec {
       return Z3_mk_const(ctxt, newSymbol(), getPointerSort());
     }
 
+    Z3_ast createVarBool() {
+      return Z3_mk_const(ctxt, newSymbol(), Z3_mk_bool_sort(ctxt));
+    }
+
     // memory model
     Z3_ast incAndRetPtr(Z3_ast &ptr, unsigned len) {
       Z3_ast res = ptr;
@@ -352,37 +364,10 @@ class SymExec {
       return incAndRetPtr(hptr, HEAP_SLOT_LEN);
     }
 
-    Z3_ast loadMemory(Z3_ast addr, unsigned size) {
-      assert(isPointerSort(addr) && size != 0);
-      Z3_ast res = Z3_mk_select(ctxt, memory, addr);
-
-      Z3_ast idx, cur, par;
-      for(unsigned i = 1; i < size; i++){
-        idx = createConstPointer(i);
-        cur = Z3_mk_bvadd(ctxt, addr, idx);
-        par = Z3_mk_select(ctxt, memory, cur);
-        res = Z3_mk_concat(ctxt, par, res);
-      }
-
-      return res;
-    }
-
-    void storeMemory(Z3_ast addr, Z3_ast expr) {
-      // get the size to be overriden
-      unsigned size = getExprSortSize(expr);
-
-      // override the memory
-      Z3_ast idx, cur, par;
-      for(unsigned i = 0; i < size; i++){
-        idx = createConstPointer(i);
-        cur = Z3_mk_bvadd(ctxt, addr, idx);
-        par = Z3_mk_extract(ctxt, 
-            (i + 1) * mo.getBits() - 1, i * mo.getBits(), 
-            expr);
-
-        memory = Z3_mk_store(ctxt, memory, cur, par);
-      }
-    }
+    // memory is split into one array of words per region, keyed by the
+    // word-aligned address
+    Z3_ast loadMemory(Z3_ast addr, unsigned size);
+    void storeMemory(Z3_ast addr, Z3_ast expr);
 
     // casts
     Z3_ast castMachIntTrunc(Z3_ast expr, unsigned width) {
@@ -443,11 +428,30 @@ class SymExec {
 
     // solver
     void addAssert(Z3_ast expr) {
+      if(guard != nullptr){
+        expr = Z3_mk_implies(ctxt, guard, expr);
+      }
+
       Z3_solver_assert(ctxt, solver, expr);
     }
 
-    Z3_model getModel() {
-      return Z3_solver_get_model(ctxt, solver);
+    // the path condition of the code being symbolized, the assertions and 
+    // the stores made under a guard only hold on the paths it holds on
+    void setGuard(Z3_ast g) {
+      guard = g;
+    }
+
+    // a model of the last satisfiable check, kept until released
+    Z3_model holdModel() {
+      Z3_model model = Z3_solver_get_model(ctxt, solver);
+      Z3_model_inc_ref(ctxt, model);
+      return model;
+    }
+
+    void releaseModel(Z3_model model) {
+      if(model != nullptr){
+        Z3_model_dec_ref(ctxt, model);
+      }
     }
 
     // context
@@ -459,37 +463,25 @@ class SymExec {
       return mo;
     }
 
-    // SENode getter
-    SymVar *getOrCreateVar(SENode *node, bool &exist) {
-      auto i = cache.find(node);
-      if(i != cache.end()){
-        exist = true;
-        return i->second;
-      }
-
-      exist = false;
-      SymVar *var = new SymVar();
-      cache.insert(make_pair(node, var));
-      return var;
-    }
-
-    SymVar *getVar(SENode *node) {
-      auto i = cache.find(node);
-      if(i == cache.end()){
-        return nullptr;
-      } else {
-        return i->second;
-      }
-    }
+    // SENode getter, symbols are cached by the ids of the nodes, so they
+    // must all come from the same graph
+    SymVar *getOrCreateVar(SENode *node, bool &exist);
+    SymVar *getVar(SENode *node);
 
     void simplify() {
-      for(auto &i : cache){
-        i.second->simplify(ctxt);
+      for(unsigned id : order){
+        cache[id]->simplify(ctxt);
       }
     }
 
     void complete();
 
+    // scoped symbolization, the assertions made within a scope are popped
+    // along with it, so the symbols cached in between, which they
+    // constrain, are dropped as well
+    void push();
+    void pop();
+
     // checks
     CheckResult checkOverlap(
         SymVar *src1, SymVar *len1,
@@ -499,6 +491,61 @@ class SymExec {
         Z3_ast s1, Z3_ast l1, 
         Z3_ast s2, Z3_ast l2);
 
+    // check one range against many in a single solver scope, each of the 
+    // others is fetched under its condition, if any, when models is given,
+    // it receives a held model per SAT pair and nullptr for the rest
+    void checkOverlaps(
+        SymVar *src1, SymVar *len1,
+        vector<pair<SymVar *, SymVar *>> &others,
+        vector<Z3_ast> &conds,
+        vector<CheckResult> &results,
+        vector<Z3_model> *models = nullptr);
+
+    void checkOverlaps(
+        Z3_ast s1, Z3_ast l1,
+        vector<pair<Z3_ast, Z3_ast>> &others,
+        vector<Z3_ast> &conds,
+        vector<Z3_lbool> &results,
+        vector<Z3_model> *models = nullptr);
+
+    // number of pairs settled by the pre-check and by the solver
+    unsigned getPresolved() {
+      return presolved;
+    }
+
+    unsigned getSolved() {
+      return solved;
+    }
+
+  protected:
+    bool prepareRange(SymVar *src, SymVar *len, Z3_ast &s, Z3_ast &l);
+
+    // decide the overlap syntactically for ranges of a constant length
+    // sharing a base, Z3_L_TRUE means overlapping if the trace is feasible
+    Z3_lbool preCheckOverlap(
+        Z3_ast s1, Z3_ast l1, 
+        Z3_ast s2, Z3_ast l2);
+
+    bool getConstValue(Z3_ast expr, __uint64 &val);
+    void getAffineForm(Z3_ast expr, Z3_ast &base, __uint64 &off);
+
+    // memory regions
+    MemRegion getRegion(Z3_ast addr);
+    unsigned traceRegion(Z3_ast expr, DenseMap<Z3_ast, unsigned> &seen);
+    Z3_ast inRegion(MemRegion reg, Z3_ast addr);
+
+    // word-level access
+    bool isWordAligned(Z3_ast expr);
+    int getWordForm(Z3_ast addr, Z3_ast &base, __uint64 &off);
+    Z3_ast getWordAddr(Z3_ast base, __uint64 off);
+    Z3_ast getWordShift(Z3_ast addr, unsigned num);
+    Z3_ast loadRegion(MemRegion reg, Z3_ast addr, unsigned size);
+    Z3_ast storeRegion(MemRegion reg, Z3_ast addr, Z3_ast expr);
+
+    Z3_ast createOverlap(
+        Z3_ast s1, Z3_ast l1, 
+        Z3_ast s2, Z3_ast l2);
+
   protected:
     // module info
     ModuleOracle &mo;
@@ -515,18 +562,63 @@ class SymExec {
     // symbol counter
     int varcount;
 
+    // query counters
+    unsigned presolved;
+    unsigned solved;
+
     // the memory model
-    Z3_ast memory;
+    Z3_ast memory[MEM_NUM];
+
+    // the symbols the region bases are made of
+    Z3_ast rvars[MEM_NUM];
+
+    // bytes per word and its log2
+    unsigned wsize;
+    unsigned wlog;
 
     Z3_ast sptr;
     Z3_ast eptr;
     Z3_ast hptr;
 
+    // the path guard
+    Z3_ast guard;
+
     // machine integer sorts
     map<unsigned, Z3_sort> sints;
 
-    // caches
-    map<SENode *, SymVar *> cache;
+    // caches, indexed by node id, and the ids in the order of caching
+    vector<SymVar *> cache;
+    vector<unsigned> order;
+
+    // scopes
+    struct Scope {
+      Z3_ast memory[MEM_NUM];
+      Z3_ast sptr;
+      Z3_ast eptr;
+      Z3_ast hptr;
+      Z3_ast guard;
+      map<unsigned, Z3_sort> sints;
+      unsigned vars;
+    };
+
+    vector<Scope> scopes;
+};
+
+// a symbol engine lent to the calling thread for one check, the engine of 
+// a thread is kept for the next checks, so that the context and the fixed
+// setup of the memory model are made once, and each check runs in a scope
+// of its own that is popped when the lease ends
+class SymLease {
+  public:
+    SymLease(ModuleOracle &m);
+    ~SymLease();
+
+    SymExec &get() {
+      return *sym;
+    }
+
+  protected:
+    SymExec *sym;
 };
 
 #endif /* SYMBOLIC_H_ */
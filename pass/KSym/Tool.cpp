@@ -4,6 +4,9 @@
 // option setup 
 cl::opt<string> OUTF("symf", cl::Required, cl::desc("<sym file>"));
 
+cl::opt<unsigned> JOBS("ksym-threads", cl::init(1),
+    cl::desc("number of functions to analyze in parallel"));
+
 // pass info
 char KSym::ID = 0;
 static RegisterPass<KSym> X("KSym", "Kernel Static Symbolizer", false, true);
@@ -12,10 +15,11 @@ static RegisterPass<KSym> X("KSym", "Kernel Static Symbolizer", false, true);
 Dumper DUMP;
 
 #ifdef KSYM_DEBUG
-Logger SLOG;
+thread_local Logger SLOG;
 #endif
 
-set<Function *> EXCEPT;
+thread_local set<Function *> EXCEPT;
+thread_local set<Function *> TIMEOUT;
 
 // black lists
 static const set<string> BLACKLIST({
@@ -69,48 +73,134 @@ void KSym::getAnalysisUsage(AnalysisUsage &au) const {
   au.setPreservesAll();
 }
 
+// per-function handling
+static void handleFunction(Function &f, ModuleOracle &mo, FetchIndex &fi) {
+#ifdef KSYM_DEBUG
+  SLOG.map(f.getName().str());
+#endif
+
+  FuncHandle handle(f, mo, *fi.getSites(&f));
+  handle.run();
+
+#ifdef KSYM_DEBUG
+  SLOG.pop();
+#endif
+}
+
+// worker pool, each worker owns its thread-local SLOG, EXCEPT and TIMEOUT, 
+// and hands them over to the main thread once there is no more work left
+struct WorkerShare {
+  vector<Function *> &works;
+  ModuleOracle &mo;
+  FetchIndex &fi;
+
+  atomic<unsigned> next;
+
+  mutex lock;
+#ifdef KSYM_DEBUG
+  Logger &slog;
+#endif
+  set<Function *> &except;
+  set<Function *> &timeout;
+
+  WorkerShare(vector<Function *> &w, ModuleOracle &m, FetchIndex &f) 
+    : works(w), mo(m), fi(f), next(0),
+#ifdef KSYM_DEBUG
+    slog(SLOG),
+#endif
+    except(EXCEPT), timeout(TIMEOUT) {}
+};
+
+static void runWorker(WorkerShare *share) {
+  unsigned i;
+  while((i = share->next++) < share->works.size()){
+    handleFunction(*share->works[i], share->mo, share->fi);
+  }
+
+  lock_guard<mutex> guard(share->lock);
+
+#ifdef KSYM_DEBUG
+  share->slog.merge(SLOG);
+#endif
+
+  share->except.insert(EXCEPT.begin(), EXCEPT.end());
+  EXCEPT.clear();
+
+  share->timeout.insert(TIMEOUT.begin(), TIMEOUT.end());
+  TIMEOUT.clear();
+}
+
 // entry point
 bool KSym::runOnModule(Module &m) {
   // run module pass
   breakConstantExpr(m);
 
+  // callees matched for a previous module may be stale
+  CallTable::reset();
+
   // create module-level vars
   ModuleOracle mo(m);
+  FetchIndex fi(m);
+
+  // collect functions to analyze
+  vector<Function *> works;
 
-  // per-function handling
   for(Function &f : m){
     // ignored non-defined functions
     if(f.isIntrinsic() || f.isDeclaration()){
       continue;
     }
 
+    // ignore functions without any fetch
+    if(fi.getSites(&f) == nullptr){
+      continue;
+    }
+
     // ignore blacklisted functions
     if(BLACKLIST.find(f.getName().str()) != BLACKLIST.end()){
       continue;
     }
 
-    // lower swtich here
+    // lower swtich here, before any worker starts to read the IR
     lowerSwitch(f);
 
-    // create and run function handler
-#ifdef KSYM_DEBUG
-    SLOG.map(f.getName().str());
-#endif
+    works.push_back(&f);
+  }
+
+  // per-function handling
+  unsigned num = std::min<unsigned>(JOBS.getValue(), works.size());
 
-    FuncHandle handle(f, mo);
-    handle.run();
+  if(num <= 1){
+    for(Function *f : works){
+      handleFunction(*f, mo, fi);
+    }
+  } else {
+    WorkerShare share(works, mo, fi);
 
-#ifdef KSYM_DEBUG
-    SLOG.pop();
-#endif
+    vector<thread> pool;
+    for(unsigned i = 0; i < num; i++){
+      pool.push_back(thread(runWorker, &share));
+    }
+
+    for(thread &t : pool){
+      t.join();
+    }
+  }
+
+  // dump exceptions (in module order to be deterministic)
+  for(Function *ex : works){
+    if(EXCEPT.find(ex) != EXCEPT.end()){
+      errs() << "[!] " << ex->getName() << "\n";
+    }
   }
 
-  // dump exceptions
-  for(Function *ex : EXCEPT){
-    errs() << "[!] " << ex->getName() << "\n";
+  // dump functions that ran out of budget
+  for(Function *to : works){
+    if(TIMEOUT.find(to) != TIMEOUT.end()){
+      errs() << "[T] " << to->getName() << "\n";
+    }
   }
 
   // mark nothing have changed
   return false;
 }
-
@@ -1,2 +1,84 @@
 // SPDX-License-Identifier: MIT
 #include "Project.h"
+
+// work-stealing scheduler
+TraceSched::TraceSched(unsigned n, unsigned total) : num(n) {
+  assert(num != 0);
+  ranges = new Range[num];
+
+  // evenly split the works, the first ones take the remainders
+  unsigned base = total / num, rest = total % num, cur = 0;
+  for(unsigned i = 0; i < num; i++){
+    ranges[i].lo = cur;
+    cur += base + (i < rest ? 1 : 0);
+    ranges[i].hi = cur;
+  }
+
+  assert(cur == total);
+}
+
+bool TraceSched::steal(unsigned wid) {
+  unsigned lo, hi;
+
+  for(unsigned c = 1; c < num; c++){
+    Range &victim = ranges[(wid + c) % num];
+
+    {
+      lock_guard<mutex> guard(victim.lock);
+      if(victim.lo == victim.hi){
+        continue;
+      }
+
+      hi = victim.hi;
+      lo = victim.lo + (victim.hi - victim.lo) / 2;
+      victim.hi = lo;
+    }
+
+    lock_guard<mutex> guard(ranges[wid].lock);
+    ranges[wid].lo = lo;
+    ranges[wid].hi = hi;
+    return true;
+  }
+
+  return false;
+}
+
+bool TraceSched::next(unsigned wid, unsigned &idx) {
+  Range &own = ranges[wid];
+
+  while(true) {
+    {
+      lock_guard<mutex> guard(own.lock);
+      if(own.lo != own.hi){
+        idx = own.lo++;
+        return true;
+      }
+    }
+
+    // nothing left anywhere
+    if(!steal(wid)){
+      return false;
+    }
+  }
+}
+
+void TraceSched::run(const function<void(unsigned, unsigned)> &func) {
+  auto worker = [this, &func](unsigned wid) {
+    unsigned idx;
+    while(next(wid, idx)){
+      func(wid, idx);
+    }
+  };
+
+  vector<thread> pool;
+  for(unsigned i = 1; i < num; i++){
+    pool.push_back(thread(worker, i));
+  }
+
+  // the calling thread acts as worker 0
+  worker(0);
+
+  for(thread &t : pool){
+    t.join();
+  }
+}
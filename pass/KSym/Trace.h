@@ -6,7 +6,48 @@
 
 typedef pair<int, Value *> SeqStmt;
 
+// forward declerations
+struct Fetch;
+class FetchContext;
+
+// one unit of symbolic checking: a single unrolled trace toward a fetch,
+// or all of them when the trace is empty
 struct TraceWork {
+  Fetch *fetch;
+  FetchContext *ctx;
+  BlockTrace trace;
+
+  TraceWork(Fetch *f, FetchContext *c, BlockTrace t)
+    : fetch(f), ctx(c), trace(t) {}
+};
+
+// work-stealing scheduler over a fixed set of works, each worker owns a
+// range of work indices and consumes it from the front, when exhausted, it
+// steals the back half of the first non-empty range of the others
+class TraceSched {
+  public:
+    TraceSched(unsigned n, unsigned total);
+
+    ~TraceSched() {
+      delete[] ranges;
+    }
+
+    // run func(worker, work) on all works with n threads
+    void run(const function<void(unsigned, unsigned)> &func);
+
+  protected:
+    bool next(unsigned wid, unsigned &idx);
+    bool steal(unsigned wid);
+
+  protected:
+    struct Range {
+      mutex lock;
+      unsigned lo;
+      unsigned hi;
+    };
+
+    unsigned num;
+    Range *ranges;
 };
 
 #endif /* TRACE_H_ */
@@ -28,15 +28,49 @@ UnrollPath *UnrollCache::getUnrolled(DAPath *path, LLVMSliceBlock *term,
     DATrace *trace = *ti;
     assert(mark == *(trace->rbegin()));
 
-    blist *blks = new blist;
     unrollRecursive(trace->begin(), trace->end(), 
-        term, graph, blks, unrolled);
+        term, graph, BlockTrace(), unrolled);
   }
 
   cache.insert(make_pair(k, unrolled));
   return unrolled;
 }
 
+UnrollTrie::UnrollTrie(UnrollPath *unrolled) {
+  root = new Node(nullptr);
+  nodes.push_back(root);
+
+  vector<LLVMSliceBlock *> blks;
+
+  UnrollPath::iterator ti = unrolled->begin(), te = unrolled->end();
+  for(; ti != te; ++ti){
+    Node *cur = root;
+
+    blks.clear();
+    ti->collect(blks);
+
+    for(LLVMSliceBlock *blk : blks){
+      Node *next = nullptr;
+      for(Node *c : cur->children){
+        if(c->block == blk){
+          next = c;
+          break;
+        }
+      }
+
+      if(next == nullptr){
+        next = new Node(blk);
+        nodes.push_back(next);
+        cur->children.push_back(next);
+      }
+
+      cur = next;
+    }
+
+    cur->term = true;
+  }
+}
+
 static bool isLinked(LLVMSliceBlock *from, LLVMSliceBlock *to) {
   LLVMSliceBlock::succ_iterator si = from->succ_begin(), se = from->succ_end();
   for(; si != se; ++si){
@@ -48,8 +82,20 @@ static bool isLinked(LLVMSliceBlock *from, LLVMSliceBlock *to) {
   return false;
 }
 
+BlockTrace UnrollCache::extend(BlockTrace blks, const BlockTrace &seg) {
+  vector<LLVMSliceBlock *> seq;
+  seg.collect(seq);
+
+  for(LLVMSliceBlock *b : seq){
+    blks = blks.extend(b, pool);
+  }
+
+  return blks;
+}
+
 void UnrollCache::unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
-    LLVMSliceBlock *term, DAGraph *graph, blist *blks, UnrollPath *unrolled) {
+    LLVMSliceBlock *term, DAGraph *graph, BlockTrace blks, 
+    UnrollPath *unrolled) {
 
   // test if reached the end of the DATrace
   if(cur == end){
@@ -62,8 +108,8 @@ void UnrollCache::unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
   cur++;
 
   if(DABlock *dab = dyn_cast<DABlock>(item)){
-    blks->push_back(dab->getBlock());
-    unrollRecursive(cur, end, term, graph, blks, unrolled);
+    unrollRecursive(cur, end, term, graph, 
+        blks.extend(dab->getBlock(), pool), unrolled);
   }
 
   else if(DALoop *dal = dyn_cast<DALoop>(item)){
@@ -93,7 +139,8 @@ void UnrollCache::unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
       linkPaths.insert(make_pair(l, getUnrolled(sub->getPath(l), l, sub)));
     }
 
-    // pick one link path to unroll the loop
+    // pick one link path to unroll the loop, the traces only allocate the
+    // blocks past the shared prefix
     for(auto const &i : linkPaths){
       UnrollPath *ps = i.second;
       
@@ -104,17 +151,16 @@ void UnrollCache::unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
           continue;
         }
 
-        blist *nbl = new blist(*blks);
-        nbl->insert(nbl->end(), (*pi)->begin(), (*pi)->end());
-        
-        unrollRecursive(cur, end, term, graph, nbl, unrolled);
+        unrollRecursive(cur, end, term, graph, extend(blks, *pi), unrolled);
       }
     }
 
 #ifdef KSYM_CONFIG_UNROLL_ONCE
     // unroll paths to latches
     SmallVector<LLVMSliceBlock *, 32> latches;
-    loop->getLoopLatches(latches);
+    if(!isSummarized(loop)){
+      loop->getLoopLatches(latches);
+    }
 
     map<LLVMSliceBlock *, UnrollPath *> latchPaths;
     for(LLVMSliceBlock *l : latches){
@@ -141,21 +187,328 @@ void UnrollCache::unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
               continue;
             }
 
-            blist *nbl = new blist(*blks);
-            nbl->insert(nbl->end(), (*jpi)->begin(), (*jpi)->end());
-            nbl->insert(nbl->end(), (*ipi)->begin(), (*ipi)->end());
-            
-            unrollRecursive(cur, end, term, graph, nbl, unrolled);
+            unrollRecursive(cur, end, term, graph, 
+                extend(extend(blks, *jpi), *ipi), unrolled);
           }
         }
       }
     }
 #endif
-
-    delete blks;
   }
 
   else {
     llvm_unreachable("Unknown DAItem type");
   }
 }
+
+// trace counting
+static inline uint64_t addSaturated(uint64_t a, uint64_t b) {
+  return a + b < a ? UINT64_MAX : a + b;
+}
+
+static inline uint64_t mulSaturated(uint64_t a, uint64_t b) {
+  if(a != 0 && b > UINT64_MAX / a){
+    return UINT64_MAX;
+  }
+
+  return a * b;
+}
+
+uint64_t UnrollCache::countOptions(DAGraph *graph, DAItem *item, 
+    DAItem *next, LLVMSliceBlock *term) {
+
+  if(isa<DABlock>(item)){
+    return 1;
+  }
+
+  DALoop *dal = cast<DALoop>(item);
+  LLVMSliceLoop *loop = dal->getLoop();
+  DAGraph *sub = graph->subgraph(dal);
+
+  // mirror the link selection in unrollRecursive
+  set<LLVMSliceBlock *> links;
+  if(next != nullptr){
+    SmallVector<LLVMSliceBlock *, 32> exits;
+    loop->getExitingBlocks(exits);
+
+    for(LLVMSliceBlock *e : exits){
+      if(isLinked(e, next->entrance())){
+        links.insert(e);
+      }
+    }
+  } else {
+    links.insert(term);
+  }
+
+  uint64_t res = 0;
+  for(LLVMSliceBlock *l : links){
+    res = addSaturated(res, std::min<uint64_t>(
+          countUnrolled(sub, l), KSYM_CONFIG_UNROLL_TOTAL_LIMIT));
+  }
+
+#ifdef KSYM_CONFIG_UNROLL_ONCE
+  SmallVector<LLVMSliceBlock *, 32> latches;
+  if(!isSummarized(loop)){
+    loop->getLoopLatches(latches);
+  }
+
+  set<LLVMSliceBlock *> lset(latches.begin(), latches.end());
+  for(LLVMSliceBlock *l : links){
+    for(LLVMSliceBlock *h : lset){
+      res = addSaturated(res, mulSaturated(
+            std::min<uint64_t>(countUnrolled(sub, l), 
+              KSYM_CONFIG_UNROLL_LINK_LIMIT),
+            std::min<uint64_t>(countUnrolled(sub, h), 
+              KSYM_CONFIG_UNROLL_LATCH_LIMIT)));
+    }
+  }
+#endif
+
+  return res;
+}
+
+uint64_t UnrollCache::countUnrolled(DAGraph *graph, LLVMSliceBlock *term) {
+  auto k = make_pair(graph, term);
+
+  auto i = counts.find(k);
+  if(i != counts.end()){
+    return i->second;
+  }
+
+  DAItem *mark = graph->query(term);
+  assert(mark != nullptr);
+
+  DAItem *root = graph->getRoot();
+
+  // order the items that may precede the mark, preds first
+  vector<DAItem *> order;
+  graph->topsort(mark, order);
+
+  // number of unrolled prefixes arriving at each item, excluding the item
+  map<DAItem *, uint64_t> arrive;
+
+  for(DAItem *cur : order){
+    uint64_t num = 0;
+
+    if(cur == root){
+      num = 1;
+    } else {
+      DAItem::iterator pi = cur->predBegin(), pe = cur->predEnd();
+      for(; pi != pe; ++pi){
+        auto j = arrive.find(*pi);
+        if(j == arrive.end() || j->second == 0){
+          continue;
+        }
+
+        num = addSaturated(num, mulSaturated(j->second, 
+              countOptions(graph, *pi, cur, term)));
+      }
+    }
+
+    arrive.insert(make_pair(cur, num));
+  }
+
+  uint64_t res = mulSaturated(arrive[mark], 
+      countOptions(graph, mark, nullptr, term));
+
+  counts.insert(make_pair(k, res));
+  return res;
+}
+
+// lazy unrolling
+UnrollGen::UnrollGen(UnrollCache &c, DAGraph *g, LLVMSliceBlock *t)
+  : cache(c), graph(g), term(t), active(false) {
+
+  DAItem *mark = graph->query(term);
+  assert(mark != nullptr);
+
+  stack.push_back(Frame(mark));
+}
+
+bool UnrollGen::nextTrace() {
+  DAItem *root = graph->getRoot();
+
+  while(!stack.empty()){
+    Frame &f = stack.back();
+
+    if(f.item == root){
+      if(f.done){
+        stack.pop_back();
+        continue;
+      }
+
+      // reached the root, the stack holds a trace in reverse
+      f.done = true;
+
+      steps.clear();
+      for(auto i = stack.rbegin(), ie = stack.rend(); i != ie; ++i){
+        steps.push_back(i->item);
+      }
+
+      return true;
+    }
+
+    if(f.cur == f.end){
+      stack.pop_back();
+      continue;
+    }
+
+    DAItem *pred = *f.cur;
+    ++f.cur;
+
+    stack.push_back(Frame(pred));
+  }
+
+  return false;
+}
+
+bool UnrollGen::prepareOptions() {
+  options.clear();
+  options.resize(steps.size());
+
+  for(unsigned c = 0; c < steps.size(); c++){
+    DAItem *item = steps[c];
+    vector<Option> &opts = options[c];
+
+    if(DABlock *dab = dyn_cast<DABlock>(item)){
+      opts.push_back(Option(dab->getBlock(), BlockTrace(), BlockTrace()));
+    }
+
+    else if(DALoop *dal = dyn_cast<DALoop>(item)){
+      LLVMSliceLoop *loop = dal->getLoop();
+      DAGraph *sub = graph->subgraph(dal);
+
+      // collect and unroll paths to links
+      set<LLVMSliceBlock *> links;
+      if(c + 1 != steps.size()){
+        // the loop is not the final step
+        SmallVector<LLVMSliceBlock *, 32> exits;
+        loop->getExitingBlocks(exits);
+
+        LLVMSliceBlock *next = steps[c + 1]->entrance();
+        for(LLVMSliceBlock *e : exits){
+          if(isLinked(e, next)){
+            links.insert(e);
+          }
+        }
+      } else {
+        // the loop is the final step
+        links.insert(term);
+      }
+
+      map<LLVMSliceBlock *, UnrollPath *> linkPaths;
+      for(LLVMSliceBlock *l : links){
+        linkPaths.insert(make_pair(l, 
+              cache.getUnrolled(sub->getPath(l), l, sub)));
+      }
+
+      // pick one link path to unroll the loop
+      for(auto const &i : linkPaths){
+        unsigned n = 0;
+        for(BlockTrace &p : *i.second){
+          if(n++ >= KSYM_CONFIG_UNROLL_TOTAL_LIMIT){
+            break;
+          }
+
+          opts.push_back(Option(nullptr, BlockTrace(), p));
+        }
+      }
+
+#ifdef KSYM_CONFIG_UNROLL_ONCE
+      // unroll paths to latches
+      SmallVector<LLVMSliceBlock *, 32> latches;
+      if(!cache.isSummarized(loop)){
+        loop->getLoopLatches(latches);
+      }
+
+      map<LLVMSliceBlock *, UnrollPath *> latchPaths;
+      for(LLVMSliceBlock *l : latches){
+        latchPaths.insert(make_pair(l, 
+              cache.getUnrolled(sub->getPath(l), l, sub)));
+      }
+
+      // pick one latch path and one link path to unroll the loop
+      for(auto const &i : linkPaths){
+        for(auto const &j : latchPaths){
+          unsigned ic = 0;
+          for(BlockTrace &ip : *i.second){
+            if(ic++ >= KSYM_CONFIG_UNROLL_LINK_LIMIT){
+              break;
+            }
+
+            unsigned jc = 0;
+            for(BlockTrace &jp : *j.second){
+              if(jc++ >= KSYM_CONFIG_UNROLL_LATCH_LIMIT){
+                break;
+              }
+
+              opts.push_back(Option(nullptr, jp, ip));
+            }
+          }
+        }
+      }
+#endif
+    }
+
+    else {
+      llvm_unreachable("Unknown DAItem type");
+    }
+
+    // this DAG trace cannot be unrolled
+    if(opts.empty()){
+      return false;
+    }
+  }
+
+  picks.assign(steps.size(), 0);
+  return true;
+}
+
+bool UnrollGen::next(blist &blks) {
+  while(true){
+    if(!active){
+      if(!nextTrace()){
+        return false;
+      }
+
+      if(!prepareOptions()){
+        continue;
+      }
+
+      active = true;
+    }
+
+    else {
+      // advance the picks, the last step varies the fastest
+      int c = steps.size() - 1;
+      for(; c >= 0; c--){
+        if(++picks[c] < options[c].size()){
+          break;
+        }
+
+        picks[c] = 0;
+      }
+
+      if(c < 0){
+        active = false;
+        continue;
+      }
+    }
+
+    // assemble the trace
+    blks.clear();
+
+    for(unsigned c = 0; c < steps.size(); c++){
+      Option &opt = options[c][picks[c]];
+
+      if(opt.block != nullptr){
+        blks.push_back(opt.block);
+      }
+
+      opt.latch.appendTo(blks);
+      opt.link.appendTo(blks);
+    }
+
+    return true;
+  }
+}
@@ -6,17 +6,68 @@
 
 typedef list<LLVMSliceBlock *> blist;
 
-class UnrollPath {
+// a trace of blocks kept as a persistent list linked from its tail, so the
+// traces extended from a common prefix share the nodes of the prefix
+class BlockTrace {
   public:
-    UnrollPath() {}
+    struct Node {
+      LLVMSliceBlock *block;
+      const Node *prev;
+    };
+
+    typedef deque<Node> Pool;
+
+    BlockTrace() : tail(nullptr), len(0) {}
+
+    ~BlockTrace() {}
+
+    // a new trace, this one is left intact
+    BlockTrace extend(LLVMSliceBlock *b, Pool &pool) const {
+      Node node = {b, tail};
+      pool.push_back(node);
+      return BlockTrace(&pool.back(), len + 1);
+    }
 
-    ~UnrollPath() {
-      for(blist *i : traces){
-        delete i;
+    unsigned size() const {
+      return len;
+    }
+
+    bool empty() const {
+      return len == 0;
+    }
+
+    // the blocks in order
+    void collect(vector<LLVMSliceBlock *> &blks) const {
+      unsigned base = blks.size();
+      blks.resize(base + len);
+
+      unsigned c = base + len;
+      for(const Node *n = tail; n != nullptr; n = n->prev){
+        blks[--c] = n->block;
       }
     }
 
-    void add(blist *trace) {
+    void appendTo(blist &blks) const {
+      vector<LLVMSliceBlock *> seq;
+      collect(seq);
+      blks.insert(blks.end(), seq.begin(), seq.end());
+    }
+
+  protected:
+    BlockTrace(const Node *t, unsigned l) : tail(t), len(l) {}
+
+  protected:
+    const Node *tail;
+    unsigned len;
+};
+
+class UnrollPath {
+  public:
+    UnrollPath() {}
+
+    ~UnrollPath() {}
+
+    void add(const BlockTrace &trace) {
       traces.push_back(trace);
     }
 
@@ -24,7 +75,7 @@ class UnrollPath {
       return traces.size();
     }
 
-    typedef typename list<blist *>::iterator iterator;
+    typedef typename vector<BlockTrace>::iterator iterator;
 
     iterator begin() {
       return traces.begin();
@@ -35,7 +86,42 @@ class UnrollPath {
     }
 
   protected:
-    list<blist *> traces;
+    // the nodes are owned by the cache
+    vector<BlockTrace> traces;
+};
+
+// the unrolled traces of a path merged on their common prefixes
+class UnrollTrie {
+  public:
+    struct Node {
+      LLVMSliceBlock *block;
+      // a trace ends at this node
+      bool term;
+      vector<Node *> children;
+
+      Node(LLVMSliceBlock *b) : block(b), term(false) {}
+    };
+
+    UnrollTrie(UnrollPath *unrolled);
+
+    ~UnrollTrie() {
+      for(Node *n : nodes){
+        delete n;
+      }
+    }
+
+    Node *getRoot() {
+      return root;
+    }
+
+    // number of blocks after merging
+    unsigned size() {
+      return nodes.size() - 1;
+    }
+
+  protected:
+    Node *root;
+    vector<Node *> nodes;
 };
 
 class UnrollCache {
@@ -50,12 +136,90 @@ class UnrollCache {
 
     UnrollPath *getUnrolled(DAPath *path, LLVMSliceBlock *term, DAGraph *graph);
 
+    // number of traces getUnrolled would produce, saturated at UINT64_MAX,
+    // without enumerating them
+    uint64_t countUnrolled(DAGraph *graph, LLVMSliceBlock *term);
+
+    // loops whose iterations are checked in closed form, by header, are
+    // taken along their link paths only, set before any unrolling, this
+    // only matters with KSYM_CONFIG_UNROLL_ONCE, as without it every loop
+    // is taken that way
+    void addSummarized(BasicBlock *header) {
+      summarized.insert(header);
+    }
+
+    bool isSummarized(LLVMSliceLoop *loop) {
+      return summarized.count(loop->getHeader()->getBasicBlock()) != 0;
+    }
+
   protected:
+    uint64_t countOptions(DAGraph *graph, DAItem *item, DAItem *next, 
+        LLVMSliceBlock *term);
+
     void unrollRecursive(DATrace::iterator cur, DATrace::iterator end,
-        LLVMSliceBlock *term, DAGraph *graph, blist *blks, UnrollPath *unrolled);
+        LLVMSliceBlock *term, DAGraph *graph, BlockTrace blks, 
+        UnrollPath *unrolled);
+
+    BlockTrace extend(BlockTrace blks, const BlockTrace &seg);
 
   protected:
     map<pair<DAPath *, LLVMSliceBlock *>, UnrollPath *> cache;
+    BlockTrace::Pool pool;
+    map<pair<DAGraph *, LLVMSliceBlock *>, uint64_t> counts;
+    set<BasicBlock *> summarized;
+};
+
+// pull-based enumeration of the unrolled traces toward a block of a graph,
+// in the same order as UnrollCache::getUnrolled, but holding only one DAG
+// trace and the unrolled paths of its loops at a time
+class UnrollGen {
+  public:
+    UnrollGen(UnrollCache &c, DAGraph *g, LLVMSliceBlock *t);
+
+    ~UnrollGen() {}
+
+    // the next trace, false if exhausted
+    bool next(blist &blks);
+
+  protected:
+    bool nextTrace();
+    bool prepareOptions();
+
+  protected:
+    // one way to pass a step of the DAG trace
+    struct Option {
+      LLVMSliceBlock *block;
+      BlockTrace latch;
+      BlockTrace link;
+
+      Option(LLVMSliceBlock *b, BlockTrace h, BlockTrace k) 
+        : block(b), latch(h), link(k) {}
+    };
+
+    // DFS over the preds, from the target up to the root
+    struct Frame {
+      DAItem *item;
+      DAItem::iterator cur;
+      DAItem::iterator end;
+      bool done;
+
+      Frame(DAItem *i) 
+        : item(i), cur(i->predBegin()), end(i->predEnd()), done(false) {}
+    };
+
+    // context
+    UnrollCache &cache;
+    DAGraph *graph;
+    LLVMSliceBlock *term;
+
+    // the current DAG trace
+    vector<Frame> stack;
+    vector<DAItem *> steps;
+
+    // the options per step and the current pick
+    vector<vector<Option>> options;
+    vector<unsigned> picks;
+    bool active;
 };
 
 #endif /* UNROLL_H_ */
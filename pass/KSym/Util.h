@@ -34,4 +34,87 @@ class Dumper {
     void typedExpr(Z3_context ctxt, Z3_ast ast);
 };
 
+// wall-clock budget in milliseconds, a zero limit means unlimited
+class Budget {
+  public:
+    Budget(uint64_t ms) 
+      : limit(ms), begin(chrono::steady_clock::now()) {}
+
+    ~Budget() {}
+
+    uint64_t elapsed() {
+      return chrono::duration_cast<chrono::milliseconds>(
+          chrono::steady_clock::now() - begin).count();
+    }
+
+    bool expired() {
+      return limit != 0 && elapsed() >= limit;
+    }
+
+  protected:
+    uint64_t limit;
+    chrono::steady_clock::time_point begin;
+};
+
+// a set of blocks of a function, viewed as a bitset over the block numbers
+class BlockSet {
+  public:
+    BlockSet() : blocks(nullptr), ids(nullptr), bits(nullptr) {}
+
+    BlockSet(const vector<BasicBlock *> *b, 
+        const DenseMap<BasicBlock *, unsigned> *i, const BitVector *s)
+      : blocks(b), ids(i), bits(s) {}
+
+    ~BlockSet() {}
+
+    bool contains(BasicBlock *bb) const {
+      auto i = ids->find(bb);
+      return i != ids->end() && bits->test(i->second);
+    }
+
+    unsigned size() const {
+      return bits->count();
+    }
+
+    class iterator {
+      public:
+        iterator(const BlockSet *s, int i) : owner(s), idx(i) {}
+
+        BasicBlock *operator*() const {
+          return (*owner->blocks)[idx];
+        }
+
+        iterator &operator++() {
+          idx = owner->bits->find_next(idx);
+          return *this;
+        }
+
+        bool operator==(const iterator &other) const {
+          return idx == other.idx;
+        }
+
+        bool operator!=(const iterator &other) const {
+          return idx != other.idx;
+        }
+
+      protected:
+        const BlockSet *owner;
+        int idx;
+    };
+
+    iterator begin() const {
+      return iterator(this, bits->find_first());
+    }
+
+    iterator end() const {
+      return iterator(this, -1);
+    }
+
+  protected:
+    // owned by the numbering side
+    const vector<BasicBlock *> *blocks;
+    const DenseMap<BasicBlock *, unsigned> *ids;
+    const BitVector *bits;
+};
+
 #endif /* UTIL_H_ */
@@ -0,0 +1,28 @@
+#include "common.h"
+
+/*
+ * expected:
+ *   loop fetch x loop fetch          UNSAT (summarized self pair)
+ *   last fetch x loop fetch          SAT   (read by the last iteration)
+ *   past fetch x loop fetch          UNSAT (right past the loop range)
+ *   past fetch x last fetch          UNSAT
+ */
+int handle(long *dst, long __user *src, int num) {
+  int i;
+  long last, past;
+
+  /* one element per iteration, never the same one twice */
+  for(i = 0; i < num; i++){
+    get_user(dst[i], src + i);
+  }
+
+  /* only a later iteration reads this one */
+  get_user(last, src + num - 1);
+
+  /* and none reads this one */
+  get_user(past, src + num);
+
+  return last + past;
+}
+
+REST_OF_MODULE
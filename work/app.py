@@ -831,8 +831,13 @@ class App(object):
                 return False
 
             cmd = PoolWork(redir, red, 
-                    "%s -load %s -KSym -symf %s -disable-verify %s" % \
-                            (LLVM_BIN_OPT, PASS_KSYM, out, inf))
+                    "%s -load %s -KSym -symf %s " \
+                    "-ksym-func-budget %d -ksym-fetch-budget %d " \
+                    "-ksym-query-budget %d -ksym-path-limit %d " \
+                    "-disable-verify %s" % \
+                            (LLVM_BIN_OPT, PASS_KSYM, out, 
+                                OPTS_BUDGET_FUNC, OPTS_BUDGET_FETCH, 
+                                OPTS_BUDGET_QUERY, OPTS_PATH_LIMIT, inf))
 
             cmds.append(cmd)
             outs.append(out)
@@ -961,7 +966,8 @@ class App(object):
                         if len(content) != 0:
                             LOG_WRN(resolve(dname, fn))
                             for line in content.splitlines():
-                                if line.startswith("[!]"):
+                                if line.startswith("[!]") or \
+                                        line.startswith("[T]"):
                                     continue
 
                                 toks = line.split("::")
@@ -61,3 +61,11 @@ LLVM_SYMS = join(PATH_LLVM, "syms")
 # opts
 OPTS_NCPU = cpu_count()
 OPTS_TIME = 43200
+
+# in-pass budgets (function/fetch in seconds, query in milliseconds)
+OPTS_BUDGET_FUNC = 3600
+OPTS_BUDGET_FETCH = 1200
+OPTS_BUDGET_QUERY = 60000
+
+# fetches with more traces than this are sampled
+OPTS_PATH_LIMIT = 100000